@@ -0,0 +1,125 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Frame Buffer Device Backends
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Everything the library does with a device goes through a backend, which
+ *  opens it by name and carries out its ioctls. The kernel backend uses the
+ *  device node; the fake one (fakefb.c) is a frame buffer in memory, so
+ *  fbset can be tried and measured without graphics hardware.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "fb.h"
+
+#include "fbset.h"
+
+
+    /*
+     *  Device Nodes of the Kernel
+     */
+
+struct KernelDevice {
+    int fd;
+    char name[1];			/* for opening it writable */
+};
+
+static int KernelOpen(const char *name, void **dev)
+{
+    struct KernelDevice *kd;
+
+    if (!(kd = malloc(sizeof(*kd)+strlen(name))))
+	return ENOMEM;
+    strcpy(kd->name, name);
+    if ((kd->fd = open(name, O_RDONLY)) == -1) {
+	free(kd);
+	return errno;
+    }
+    *dev = kd;
+    return 0;
+}
+
+
+static void KernelClose(void *dev)
+{
+    struct KernelDevice *kd = dev;
+
+    close(kd->fd);
+    free(kd);
+}
+
+
+static int KernelIoctl(void *dev, int request, void *arg)
+{
+    struct KernelDevice *kd = dev;
+
+    return ioctl(kd->fd, request, arg) ? errno : 0;
+}
+
+
+    /*
+     *  Map the Memory of a Device Node
+     *
+     *  The node is only open for reading, as setting video modes needs no
+     *  more, so mapping it for writing opens it again.
+     */
+
+static int KernelMap(void *dev, size_t len, int writable, void **mem)
+{
+    struct KernelDevice *kd = dev;
+    int fd, error = 0;
+
+    if (!writable) {
+	*mem = mmap(NULL, len, PROT_READ, MAP_SHARED, kd->fd, 0);
+	return *mem == MAP_FAILED ? errno : 0;
+    }
+    if ((fd = open(kd->name, O_RDWR)) == -1)
+	return errno;
+    *mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (*mem == MAP_FAILED)
+	error = errno;
+    close(fd);
+    return error;
+}
+
+
+static void KernelUnmap(void *dev, void *mem, size_t len)
+{
+    munmap(mem, len);
+}
+
+
+const struct DeviceBackend KernelBackend = {
+    "kernel", KernelOpen, KernelClose, KernelIoctl, KernelMap, KernelUnmap
+};
+
+
+    /*
+     *  Find the Backend of a Device
+     *
+     *  `fake', optionally followed by `:' and options, is the fake frame
+     *  buffer, unless a file of that name exists; any other name is a
+     *  device node.
+     */
+
+const struct DeviceBackend *FindBackend(const char *name)
+{
+    if (!strncmp(name, "fake", 4) && (!name[4] || name[4] == ':') &&
+	access(name, F_OK))
+	return &FakeBackend;
+    return &KernelBackend;
+}
@@ -0,0 +1,417 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Fake Frame Buffer Device
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  A frame buffer that only exists in memory, behaving like the virtual
+ *  frame buffer of the kernel (vfb): video modes are checked against the
+ *  size of its memory, with lines padded to 32 bits, and only set with
+ *  FB_ACTIVATE_NOW. Its name is `fake', optionally followed by options,
+ *  each after a `:':
+ *
+ *	mem=<bytes>	size of the frame buffer memory, with k or M for
+ *			kilobytes or megabytes (default 8M)
+ *	delay=<usecs>	time every ioctl takes, spent busy (default 0)
+ *	id=<name>	identification of the driver (default `Fake FB')
+ *	file=<path>	file holding the frame buffer memory, created if
+ *			needed; an existing one must have the size of the
+ *			memory (default anonymous memory)
+ *
+ *  Every open gives a new device, starting with 640x480 at 8 bpp, so it
+ *  needs at least 300k of memory. The memory is only allocated when it is
+ *  first mapped.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fb.h"
+
+#include "fbset.h"
+
+
+#define FAKE_MEM	(8*1024*1024)
+#define FAKE_ID		"Fake FB"
+
+struct FakeDevice {
+    struct fb_var_screeninfo var;
+    struct fb_fix_screeninfo fix;
+    unsigned long long delay;		/* per ioctl, in nanoseconds */
+    char *file;				/* NULL for anonymous memory */
+    void *mem;				/* NULL until mapped */
+    int writable;			/* mem is */
+};
+
+static const struct fb_var_screeninfo FakeMode = {
+    640, 480, 640, 480, 0, 0, 8, 0,	/* geometry */
+    { 0, 8, 0 }, { 0, 8, 0 }, { 0, 8, 0 }, { 0, 0, 0 },
+    0, 0, -1, -1, 0,
+    39722, 48, 16, 33, 10, 96, 2,	/* timings */
+    0, FB_VMODE_NONINTERLACED
+};
+
+
+    /*
+     *  Bytes per Line, padded to 32 bits
+     */
+
+static __u32 FakeLineLength(__u32 xres_virtual, __u32 bpp)
+{
+    return (((unsigned long long)xres_virtual*bpp+31) & ~31ULL) >> 3;
+}
+
+
+    /*
+     *  Bytes of the Memory Mapping, in whole Pages
+     */
+
+static size_t FakeMapLength(const struct FakeDevice *fake)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return ((size_t)fake->fix.smem_len+page-1) & ~(page-1);
+}
+
+
+    /*
+     *  Spend the Time an Ioctl takes
+     */
+
+static void FakeDelay(const struct FakeDevice *fake)
+{
+    struct timespec ts;
+    unsigned long long end, now;
+
+    if (!fake->delay)
+	return;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    end = ts.tv_sec*1000000000ULL+ts.tv_nsec+fake->delay;
+    do {
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = ts.tv_sec*1000000000ULL+ts.tv_nsec;
+    } while (now < end);
+}
+
+
+    /*
+     *  Check and maybe Set a Video Mode
+     *
+     *  Like vfb, the geometry is adjusted to what fits, and the color layout
+     *  follows from the depth.
+     */
+
+static int FakePutVar(struct FakeDevice *fake, struct fb_var_screeninfo *arg)
+{
+    struct fb_var_screeninfo var = *arg;
+    __u32 line_length;
+
+    if (!var.xres)
+	var.xres = 1;
+    if (!var.yres)
+	var.yres = 1;
+    if (var.xres > var.xres_virtual)
+	var.xres_virtual = var.xres;
+    if (var.yres > var.yres_virtual)
+	var.yres_virtual = var.yres;
+    if (var.bits_per_pixel <= 1)
+	var.bits_per_pixel = 1;
+    else if (var.bits_per_pixel <= 8)
+	var.bits_per_pixel = 8;
+    else if (var.bits_per_pixel <= 16)
+	var.bits_per_pixel = 16;
+    else if (var.bits_per_pixel <= 24)
+	var.bits_per_pixel = 24;
+    else if (var.bits_per_pixel <= 32)
+	var.bits_per_pixel = 32;
+    else
+	return EINVAL;
+    if (var.xres_virtual < var.xoffset+var.xres)
+	var.xres_virtual = var.xoffset+var.xres;
+    if (var.yres_virtual < var.yoffset+var.yres)
+	var.yres_virtual = var.yoffset+var.yres;
+
+    line_length = FakeLineLength(var.xres_virtual, var.bits_per_pixel);
+    if ((unsigned long long)line_length*var.yres_virtual >
+	fake->fix.smem_len)
+	return ENOMEM;
+
+    memset(&var.red, 0, 4*sizeof(var.red));
+    switch (var.bits_per_pixel) {
+	case 1:
+	case 8:
+	    var.red.length = var.green.length = var.blue.length = 8;
+	    break;
+	case 16:
+	    if (arg->transp.length) {
+		/* RGBA 5551 */
+		var.red.offset = 10;
+		var.green.offset = 5;
+		var.red.length = var.green.length = var.blue.length = 5;
+		var.transp.offset = 15;
+		var.transp.length = 1;
+	    } else {
+		/* RGB 565 */
+		var.red.offset = 11;
+		var.green.offset = 5;
+		var.red.length = var.blue.length = 5;
+		var.green.length = 6;
+	    }
+	    break;
+	case 32:
+	    var.transp.offset = 24;
+	    var.transp.length = 8;
+	    /* fall through */
+	case 24:
+	    var.red.offset = 16;
+	    var.green.offset = 8;
+	    var.red.length = var.green.length = var.blue.length = 8;
+	    break;
+    }
+    *arg = var;
+    if ((var.activate & FB_ACTIVATE_MASK) == FB_ACTIVATE_TEST)
+	return 0;
+
+    var.activate = FB_ACTIVATE_NOW;
+    fake->var = var;
+    fake->fix.line_length = line_length;
+    fake->fix.visual = var.bits_per_pixel == 1 ? FB_VISUAL_MONO01 :
+		       var.bits_per_pixel == 8 ? FB_VISUAL_PSEUDOCOLOR :
+						 FB_VISUAL_TRUECOLOR;
+    return 0;
+}
+
+
+    /*
+     *  Pan or Wrap the Display
+     *
+     *  Checked like the kernel does: offsets must be multiples of the steps,
+     *  and stay within the virtual resolution, except that wrapping may go
+     *  round the end.
+     */
+
+static int FakePan(struct FakeDevice *fake,
+		   const struct fb_var_screeninfo *var)
+{
+    const struct fb_fix_screeninfo *fix = &fake->fix;
+
+    if (var->xoffset+fake->var.xres > fake->var.xres_virtual ||
+	(var->xoffset && (!fix->xpanstep || var->xoffset % fix->xpanstep)))
+	return EINVAL;
+    if (var->vmode & FB_VMODE_YWRAP) {
+	if (!fix->ywrapstep || var->yoffset % fix->ywrapstep ||
+	    var->yoffset >= fake->var.yres_virtual)
+	    return EINVAL;
+    } else if (var->yoffset+fake->var.yres > fake->var.yres_virtual ||
+	       (var->yoffset &&
+		(!fix->ypanstep || var->yoffset % fix->ypanstep)))
+	return EINVAL;
+    fake->var.xoffset = var->xoffset;
+    fake->var.yoffset = var->yoffset;
+    fake->var.vmode = (fake->var.vmode & ~FB_VMODE_YWRAP) |
+		      (var->vmode & FB_VMODE_YWRAP);
+    return 0;
+}
+
+
+    /*
+     *  Open a Fake Device, with Options after the Name
+     */
+
+static int FakeOpen(const char *name, void **dev)
+{
+    struct FakeDevice *fake;
+    struct fb_var_screeninfo var;
+    const char *opt;
+    unsigned long mem;
+    double usecs;
+    char *end;
+    size_t len;
+
+    if (!(fake = calloc(1, sizeof(*fake))))
+	return ENOMEM;
+    strcpy(fake->fix.id, FAKE_ID);
+    fake->fix.smem_len = FAKE_MEM;
+
+    for (opt = name+4; *opt == ':'; opt = end) {
+	opt++;
+	if (!(end = strchr(opt, ':')))
+	    end = (char *)opt+strlen(opt);
+	if (!strncmp(opt, "mem=", 4)) {
+	    mem = strtoul(opt+4, &end, 10);
+	    if (*end == 'k' || *end == 'K')
+		mem <<= 10, end++;
+	    else if (*end == 'M')
+		mem <<= 20, end++;
+	    if (!mem || mem > 0xffffffffUL)
+		goto invalid;
+	    fake->fix.smem_len = mem;
+	} else if (!strncmp(opt, "delay=", 6)) {
+	    usecs = strtod(opt+6, &end);
+	    if (usecs < 0 || end == opt+6)
+		goto invalid;
+	    fake->delay = usecs*1000;
+	} else if (!strncmp(opt, "id=", 3)) {
+	    len = end-(opt+3);
+	    if (!len || len >= sizeof(fake->fix.id))
+		goto invalid;
+	    memset(fake->fix.id, 0, sizeof(fake->fix.id));
+	    memcpy(fake->fix.id, opt+3, len);
+	} else if (!strncmp(opt, "file=", 5)) {
+	    len = end-(opt+5);
+	    free(fake->file);
+	    if (!len || !(fake->file = strndup(opt+5, len)))
+		goto invalid;
+	} else
+	    goto invalid;
+	if (*end && *end != ':')
+	    goto invalid;
+    }
+    if (*opt)
+	goto invalid;
+
+    fake->fix.type = FB_TYPE_PACKED_PIXELS;
+    fake->fix.xpanstep = 1;
+    fake->fix.ypanstep = 1;
+    fake->fix.ywrapstep = 1;
+    fake->fix.accel = FB_ACCEL_NONE;
+    var = FakeMode;
+    if (FakePutVar(fake, &var)) {
+	/* too little memory for the first video mode */
+	free(fake->file);
+	free(fake);
+	return ENOMEM;
+    }
+    *dev = fake;
+    return 0;
+
+invalid:
+    free(fake->file);
+    free(fake);
+    return EINVAL;
+}
+
+
+static void FakeClose(void *dev)
+{
+    struct FakeDevice *fake = dev;
+
+    if (fake->mem)
+	munmap(fake->mem, FakeMapLength(fake));
+    free(fake->file);
+    free(fake);
+}
+
+
+static int FakeIoctl(void *dev, int request, void *arg)
+{
+    struct FakeDevice *fake = dev;
+
+    FakeDelay(fake);
+    switch (request) {
+	case FBIOGET_VSCREENINFO:
+	    *(struct fb_var_screeninfo *)arg = fake->var;
+	    return 0;
+	case FBIOPUT_VSCREENINFO:
+	    return FakePutVar(fake, arg);
+	case FBIOGET_FSCREENINFO:
+	    *(struct fb_fix_screeninfo *)arg = fake->fix;
+	    return 0;
+	case FBIOPAN_DISPLAY:
+	    return FakePan(fake, arg);
+    }
+    return ENOTTY;
+}
+
+
+    /*
+     *  Map the Frame Buffer Memory
+     *
+     *  All mappings share the memory, which lasts until the device is
+     *  closed, and spans whole pages as the library expects. Memory mapped
+     *  for reading only is mapped again when it is first wanted writable. A
+     *  file that exists already is only used if it has the size of the
+     *  memory, so no other file gets cut short or grown by mistake, and one
+     *  that does not is only created for writing.
+     */
+
+static int FakeMapFile(const struct FakeDevice *fake, int writable,
+		       void **addr)
+{
+    struct stat st;
+    int fd, created = 0, error = 0;
+
+    if (!writable)
+	fd = open(fake->file, O_RDONLY);
+    else if ((fd = open(fake->file, O_RDWR | O_CREAT | O_EXCL, 0644)) != -1)
+	created = 1;
+    else if (errno == EEXIST)
+	fd = open(fake->file, O_RDWR);
+    if (fd == -1)
+	return errno;
+    if (created) {
+	if (ftruncate(fd, fake->fix.smem_len))
+	    error = errno;
+    } else if (fstat(fd, &st))
+	error = errno;
+    else if (!S_ISREG(st.st_mode) || st.st_size != fake->fix.smem_len)
+	error = EEXIST;
+    if (!error &&
+	(*addr = mmap(NULL, FakeMapLength(fake),
+		      writable ? PROT_READ | PROT_WRITE : PROT_READ,
+		      MAP_SHARED, fd, 0)) == MAP_FAILED)
+	error = errno;
+    close(fd);
+    return error;
+}
+
+
+static int FakeMap(void *dev, size_t len, int writable, void **mem)
+{
+    struct FakeDevice *fake = dev;
+    void *addr;
+    int error;
+
+    if (len > FakeMapLength(fake))
+	return EINVAL;
+    if (fake->mem && writable && !fake->writable) {
+	munmap(fake->mem, FakeMapLength(fake));
+	fake->mem = NULL;
+    }
+    if (!fake->mem) {
+	if (fake->file) {
+	    if ((error = FakeMapFile(fake, writable, &addr)))
+		return error;
+	} else if ((addr = mmap(NULL, FakeMapLength(fake),
+				writable ? PROT_READ | PROT_WRITE : PROT_READ,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) ==
+		   MAP_FAILED)
+	    return errno;
+	fake->mem = addr;
+	fake->writable = writable;
+    }
+    *mem = fake->mem;
+    return 0;
+}
+
+
+static void FakeUnmap(void *dev, void *mem, size_t len)
+{
+}
+
+
+const struct DeviceBackend FakeBackend = {
+    "fake", FakeOpen, FakeClose, FakeIoctl, FakeMap, FakeUnmap
+};
@@ -0,0 +1,281 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Frame Buffer Memory Kernels
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Ways to write, read and copy frame buffer memory, to find out which one
+ *  suits the memory of a device best: plain 64 bit accesses, the C library,
+ *  SSE2 and AVX2, with ordinary stores and with non-temporal ones, which
+ *  bypass the cache like write-combining memory does. The AVX2 kernels are
+ *  built for AVX2 whatever CC targets, and only used if the processor has
+ *  it.
+ *
+ *  The memory must be aligned to MEM_BLOCK bytes, and its length a multiple
+ *  of MEM_BLOCK.
+ */
+
+
+#include <string.h>
+
+#include "fbset.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+    /*
+     *  64 Bit Accesses
+     *
+     *  Through volatile pointers, so the compiler neither vectorizes them
+     *  nor turns them into library calls.
+     */
+
+static void ScalarWrite(void *dst, size_t len, __u64 pattern)
+{
+    volatile __u64 *p = dst;
+    size_t i;
+
+    for (i = 0; i < len/8; i++)
+	p[i] = pattern;
+}
+
+
+static __u64 ScalarRead(const void *src, size_t len)
+{
+    const volatile __u64 *p = src;
+    __u64 sum = 0;
+    size_t i;
+
+    for (i = 0; i < len/8; i++)
+	sum ^= p[i];
+    return sum;
+}
+
+
+static void ScalarCopy(void *dst, const void *src, size_t len)
+{
+    volatile __u64 *d = dst;
+    const volatile __u64 *s = src;
+    size_t i;
+
+    for (i = 0; i < len/8; i++)
+	d[i] = s[i];
+}
+
+
+    /*
+     *  The C Library
+     */
+
+static void LibcWrite(void *dst, size_t len, __u64 pattern)
+{
+    memset(dst, (int)(pattern & 0xff), len);
+}
+
+
+static void LibcCopy(void *dst, const void *src, size_t len)
+{
+    memcpy(dst, src, len);
+}
+
+
+#ifdef __SSE2__
+
+    /*
+     *  SSE2, 4 Vectors per Block
+     */
+
+static void SSE2Write(void *dst, size_t len, __u64 pattern)
+{
+    __m128i v = _mm_set1_epi64x(pattern);
+    __m128i *p = dst, *end = (__m128i *)((char *)dst+len);
+
+    for (; p < end; p += 4) {
+	_mm_store_si128(p, v);
+	_mm_store_si128(p+1, v);
+	_mm_store_si128(p+2, v);
+	_mm_store_si128(p+3, v);
+    }
+}
+
+
+static __u64 SSE2Read(const void *src, size_t len)
+{
+    const __m128i *p = src, *end = (const __m128i *)((const char *)src+len);
+    __m128i a = _mm_setzero_si128(), b = _mm_setzero_si128();
+    __u64 sum[2];
+
+    for (; p < end; p += 4) {
+	a = _mm_xor_si128(a, _mm_xor_si128(_mm_load_si128(p),
+					   _mm_load_si128(p+1)));
+	b = _mm_xor_si128(b, _mm_xor_si128(_mm_load_si128(p+2),
+					   _mm_load_si128(p+3)));
+    }
+    _mm_storeu_si128((__m128i *)sum, _mm_xor_si128(a, b));
+    return sum[0] ^ sum[1];
+}
+
+
+static void SSE2Copy(void *dst, const void *src, size_t len)
+{
+    __m128i *d = dst;
+    const __m128i *s = src, *end = (const __m128i *)((const char *)src+len);
+
+    for (; s < end; s += 4, d += 4) {
+	__m128i v0 = _mm_load_si128(s), v1 = _mm_load_si128(s+1);
+	__m128i v2 = _mm_load_si128(s+2), v3 = _mm_load_si128(s+3);
+
+	_mm_store_si128(d, v0);
+	_mm_store_si128(d+1, v1);
+	_mm_store_si128(d+2, v2);
+	_mm_store_si128(d+3, v3);
+    }
+}
+
+
+static void SSE2StreamWrite(void *dst, size_t len, __u64 pattern)
+{
+    __m128i v = _mm_set1_epi64x(pattern);
+    __m128i *p = dst, *end = (__m128i *)((char *)dst+len);
+
+    for (; p < end; p += 4) {
+	_mm_stream_si128(p, v);
+	_mm_stream_si128(p+1, v);
+	_mm_stream_si128(p+2, v);
+	_mm_stream_si128(p+3, v);
+    }
+    _mm_sfence();
+}
+
+
+static void SSE2StreamCopy(void *dst, const void *src, size_t len)
+{
+    __m128i *d = dst;
+    const __m128i *s = src, *end = (const __m128i *)((const char *)src+len);
+
+    for (; s < end; s += 4, d += 4) {
+	__m128i v0 = _mm_load_si128(s), v1 = _mm_load_si128(s+1);
+	__m128i v2 = _mm_load_si128(s+2), v3 = _mm_load_si128(s+3);
+
+	_mm_stream_si128(d, v0);
+	_mm_stream_si128(d+1, v1);
+	_mm_stream_si128(d+2, v2);
+	_mm_stream_si128(d+3, v3);
+    }
+    _mm_sfence();
+}
+
+#endif /* __SSE2__ */
+
+
+#ifdef HAVE_AVX2
+
+    /*
+     *  AVX2, 2 Vectors per Block
+     */
+
+int HaveAVX2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+
+static TARGET_AVX2 void AVX2Write(void *dst, size_t len, __u64 pattern)
+{
+    __m256i v = _mm256_set1_epi64x(pattern);
+    __m256i *p = dst, *end = (__m256i *)((char *)dst+len);
+
+    for (; p < end; p += 2) {
+	_mm256_store_si256(p, v);
+	_mm256_store_si256(p+1, v);
+    }
+}
+
+
+static TARGET_AVX2 __u64 AVX2Read(const void *src, size_t len)
+{
+    const __m256i *p = src, *end = (const __m256i *)((const char *)src+len);
+    __m256i a = _mm256_setzero_si256(), b = _mm256_setzero_si256();
+    __u64 sum[4];
+
+    for (; p < end; p += 2) {
+	a = _mm256_xor_si256(a, _mm256_load_si256(p));
+	b = _mm256_xor_si256(b, _mm256_load_si256(p+1));
+    }
+    _mm256_storeu_si256((__m256i *)sum, _mm256_xor_si256(a, b));
+    return sum[0] ^ sum[1] ^ sum[2] ^ sum[3];
+}
+
+
+static TARGET_AVX2 void AVX2Copy(void *dst, const void *src, size_t len)
+{
+    __m256i *d = dst;
+    const __m256i *s = src, *end = (const __m256i *)((const char *)src+len);
+
+    for (; s < end; s += 2, d += 2) {
+	__m256i v0 = _mm256_load_si256(s), v1 = _mm256_load_si256(s+1);
+
+	_mm256_store_si256(d, v0);
+	_mm256_store_si256(d+1, v1);
+    }
+}
+
+
+static TARGET_AVX2 void AVX2StreamWrite(void *dst, size_t len, __u64 pattern)
+{
+    __m256i v = _mm256_set1_epi64x(pattern);
+    __m256i *p = dst, *end = (__m256i *)((char *)dst+len);
+
+    for (; p < end; p += 2) {
+	_mm256_stream_si256(p, v);
+	_mm256_stream_si256(p+1, v);
+    }
+    _mm_sfence();
+}
+
+
+static TARGET_AVX2 void AVX2StreamCopy(void *dst, const void *src, size_t len)
+{
+    __m256i *d = dst;
+    const __m256i *s = src, *end = (const __m256i *)((const char *)src+len);
+
+    for (; s < end; s += 2, d += 2) {
+	__m256i v0 = _mm256_load_si256(s), v1 = _mm256_load_si256(s+1);
+
+	_mm256_stream_si256(d, v0);
+	_mm256_stream_si256(d+1, v1);
+    }
+    _mm_sfence();
+}
+
+#endif /* HAVE_AVX2 */
+
+
+    /*
+     *  All Kernels, from the Simplest
+     *
+     *  Non-temporal loads need more than SSE2, so the streaming kernels read
+     *  like the ordinary ones. The C library has no way to only read.
+     */
+
+const struct MemKernel MemKernels[] = {
+    { "scalar", ScalarWrite, ScalarRead, ScalarCopy },
+    { "libc", LibcWrite, NULL, LibcCopy },
+#ifdef __SSE2__
+    { "sse2", SSE2Write, SSE2Read, SSE2Copy },
+    { "sse2-nt", SSE2StreamWrite, SSE2Read, SSE2StreamCopy },
+#endif
+#ifdef HAVE_AVX2
+    { "avx2", AVX2Write, AVX2Read, AVX2Copy, HaveAVX2 },
+    { "avx2-nt", AVX2StreamWrite, AVX2Read, AVX2StreamCopy, HaveAVX2 },
+#endif
+    { NULL }
+};
@@ -21,13 +21,14 @@
 
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
-#include <fcntl.h>
+#include <strings.h>
 #include <errno.h>
-#include <sys/ioctl.h>
-#include <ctype.h>
-#include <sys/stat.h>
+#include <glob.h>
+#include <pthread.h>
+#include <time.h>
 
 struct file;
 struct inode;
@@ -38,17 +39,26 @@ struct inode;
 
 
     /*
-     *  Default Frame Buffer Special Device Node
+     *  Default Compiled Video Mode Database File, and that of a database
+     *  given with -db, by a hash of its absolute path
      */
 
-#define DEFAULT_FRAMEBUFFER	"/dev/fb0"
+#define DEFAULT_MODECACHE	"/var/cache/fb.modes.bin"
+#define DB_MODECACHE		"/var/cache/fb.modes-%08x.bin"
 
 
     /*
-     *  Default Video Mode Database File
+     *  Default Socket of the Daemon
      */
 
-#define DEFAULT_MODEDBFILE	"/etc/fb.modes"
+#define DEFAULT_SOCKET		"/var/run/fbset.sock"
+
+
+    /*
+     *  Default Directory of the Cached Probe Results
+     */
+
+#define DEFAULT_PROBECACHE	"/var/cache/fbset"
 
 
     /*
@@ -65,37 +75,31 @@ static int Opt_verbose = 0;
 static int Opt_xfree86 = 0;
 static int Opt_change = 0;
 static int Opt_all = 0;
+static int Opt_strict = 0;
+static int Opt_force = 0;
+static int Opt_status = 0;
+static int Opt_barrier = 0;
+static int Opt_transaction = 0;
+static int Opt_probe = 0;
+static int Opt_noprobecache = 0;
+static int Opt_stats = 0;
+static int Opt_benchpan = 0;
+static int Opt_daemon = 0;
+static int Opt_client = 0;
 
 static const char *Opt_fb = NULL;
-const char *Opt_modedb = DEFAULT_MODEDBFILE;
-static const char *Opt_xres = NULL;
-static const char *Opt_yres = NULL;
-static const char *Opt_vxres = NULL;
-static const char *Opt_vyres = NULL;
-static const char *Opt_depth = NULL;
-static const char *Opt_pixclock = NULL;
-static const char *Opt_left = NULL;
-static const char *Opt_right = NULL;
-static const char *Opt_upper = NULL;
-static const char *Opt_lower = NULL;
-static const char *Opt_hslen = NULL;
-static const char *Opt_vslen = NULL;
-static const char *Opt_accel = NULL;
-static const char *Opt_hsync = NULL;
-static const char *Opt_vsync = NULL;
-static const char *Opt_csync = NULL;
-static const char *Opt_gsync = NULL;
-static const char *Opt_extsync = NULL;
-static const char *Opt_bcast = NULL;
-static const char *Opt_laced = NULL;
-static const char *Opt_double = NULL;
-static const char *Opt_move = NULL;
-static const char *Opt_step = NULL;
+static const char *Opt_modedb = NULL;
+static const char DefaultModeCache[] = DEFAULT_MODECACHE;
+static const char *Opt_modecache = DefaultModeCache;
 static const char *Opt_modename = NULL;
-static const char *Opt_rgba = NULL;
-static const char *Opt_nonstd = NULL;
-static const char *Opt_grayscale = NULL;
-static const char *Opt_matchyres = NULL;
+static const char *Opt_socket = DEFAULT_SOCKET;
+static const char *Opt_batch = NULL;
+static const char *Opt_bench = NULL;
+static const char *Opt_benchflip = NULL;
+static const char *Opt_benchmem = NULL;
+static const char *Opt_dump = NULL;
+static const char *Opt_pattern = NULL;
+static struct FBSetModeOptions Opt_modify;
 
 static struct {
     const char *name;
@@ -104,41 +108,50 @@ static struct {
 } Options[] = {
     { "-fb", &Opt_fb, 0 },
     { "-db", &Opt_modedb, 0 },
-    { "-xres", &Opt_xres, 1 },
-    { "-yres", &Opt_yres, 1 },
-    { "-vxres", &Opt_vxres, 1 },
-    { "-vyres", &Opt_vyres, 1 },
-    { "-depth", &Opt_depth, 1 },
-    { "-nonstd", &Opt_nonstd, 1},
-    { "-pixclock", &Opt_pixclock, 1 },
-    { "-left", &Opt_left, 1 },
-    { "-right", &Opt_right, 1 },
-    { "-upper", &Opt_upper, 1 },
-    { "-lower", &Opt_lower, 1 },
-    { "-hslen", &Opt_hslen, 1 },
-    { "-vslen", &Opt_vslen, 1 },
-    { "-accel", &Opt_accel, 1 },
-    { "-hsync", &Opt_hsync, 1 },
-    { "-vsync", &Opt_vsync, 1 },
-    { "-csync", &Opt_csync, 1 },
-    { "-gsync", &Opt_gsync, 1 },
-    { "-extsync", &Opt_extsync, 1 },
-    { "-bcast", &Opt_bcast, 1 },
-    { "-laced", &Opt_laced, 1 },
-    { "-double", &Opt_double, 1 },
-    { "-move", &Opt_move, 1 },
-    { "-step", &Opt_step, 1 },
-    { "-rgba", &Opt_rgba, 1 },
-    { "-grayscale", &Opt_grayscale, 1 },
+    { "-cache", &Opt_modecache, 0 },
+    { "--socket", &Opt_socket, 0 },
+    { "--batch", &Opt_batch, 0 },
+    { "--bench-ioctl", &Opt_bench, 0 },
+    { "--bench-flip", &Opt_benchflip, 0 },
+    { "--bench-mem", &Opt_benchmem, 0 },
+    { "--dump", &Opt_dump, 0 },
+    { "--pattern", &Opt_pattern, 0 },
+    { "-xres", &Opt_modify.xres, 1 },
+    { "-yres", &Opt_modify.yres, 1 },
+    { "-vxres", &Opt_modify.vxres, 1 },
+    { "-vyres", &Opt_modify.vyres, 1 },
+    { "-depth", &Opt_modify.depth, 1 },
+    { "-nonstd", &Opt_modify.nonstd, 1},
+    { "-pixclock", &Opt_modify.pixclock, 1 },
+    { "-left", &Opt_modify.left, 1 },
+    { "-right", &Opt_modify.right, 1 },
+    { "-upper", &Opt_modify.upper, 1 },
+    { "-lower", &Opt_modify.lower, 1 },
+    { "-hslen", &Opt_modify.hslen, 1 },
+    { "-vslen", &Opt_modify.vslen, 1 },
+    { "-accel", &Opt_modify.accel, 1 },
+    { "-hsync", &Opt_modify.hsync, 1 },
+    { "-vsync", &Opt_modify.vsync, 1 },
+    { "-csync", &Opt_modify.csync, 1 },
+    { "-gsync", &Opt_modify.gsync, 1 },
+    { "-extsync", &Opt_modify.extsync, 1 },
+    { "-bcast", &Opt_modify.bcast, 1 },
+    { "-laced", &Opt_modify.laced, 1 },
+    { "-double", &Opt_modify.double_, 1 },
+    { "-move", &Opt_modify.move, 1 },
+    { "-step", &Opt_modify.step, 1 },
+    { "-buffers", &Opt_modify.buffers, 1 },
+    { "-rgba", &Opt_modify.rgba, 1 },
+    { "-grayscale", &Opt_modify.grayscale, 1 },
     { NULL, NULL, 0 }
 };
 
-
-    /*
-     *  Video Mode Database
-     */
-
-struct VideoMode *VideoModes = NULL;
+    /* not in requests of the daemon */
+static const char *const ServerOptions[] = {
+    "-db", "-cache", "--nocache", "--strict", "--daemon", "--client",
+    "--socket", "--batch", "--bench-ioctl", "--bench-flip", "--bench-mem",
+    "--dump", NULL
+};
 
 
     /*
@@ -206,402 +219,114 @@ static struct accelentry {
      *  Current Video Mode
      */
 
-struct VideoMode Current;
-
-
-    /*
-     *  Function Prototypes
-     */
-
-int OpenFrameBuffer(const char *name);
-void CloseFrameBuffer(int fh);
-void GetVarScreenInfo(int fh, struct fb_var_screeninfo *var);
-void SetVarScreenInfo(int fh, struct fb_var_screeninfo *var);
-void GetFixScreenInfo(int fh, struct fb_fix_screeninfo *fix);
-static void ConvertFromVideoMode(const struct VideoMode *vmode,
-				 struct fb_var_screeninfo *var);
-static void ConvertToVideoMode(const struct fb_var_screeninfo *var,
-			       struct VideoMode *vmode);
-static int atoboolean(const char *var);
-static void ReadModeDB(void);
-static struct VideoMode *FindVideoMode(const char *name);
-static void ModifyVideoMode(struct VideoMode *vmode);
-static void DisplayVModeInfo(struct VideoMode *vmode);
-static void DisplayFBInfo(struct fb_fix_screeninfo *fix);
-static int FillScanRates(struct VideoMode *vmode);
-static void Usage(void) __attribute__ ((noreturn));
-int main(int argc, char *argv[]);
+static struct VideoMode Current;
 
 
     /*
-     *  Print an Error Message and Exit
+     *  Open Frame Buffer Devices and the Video Mode Database of the Daemon
      */
 
-void Die(const char *fmt, ...)
-{
-    va_list ap;
+static struct Device {
+    struct Device *next;
+    struct FBSet *fs;
+    char name[1];
+} *Devices = NULL;
 
-    fflush(stdout);
-    va_start(ap, fmt);
-    vfprintf(stderr, fmt, ap);
-    va_end(ap);
-    exit(1);
-}
+static struct FBSet *Modes = NULL;
 
 
     /*
-     *  Open the Frame Buffer Device
+     *  Statistics of the Command (--stats), besides those of the Handles
      */
 
-int OpenFrameBuffer(const char *name)
-{
-    int fh;
-
-    if (Opt_verbose)
-	printf("Opening frame buffer device `%s'\n", name);
-
-    if ((fh = open(name, O_RDONLY)) == -1)
-	Die("open %s: %s\n", name, strerror(errno));
-    return fh;
-}
-
-
-    /*
-     *  Close the Frame Buffer Device
-     */
+static unsigned long long StatsStart;	/* when the command started */
+static unsigned long long DisplayNsecs;	/* in the display routines */
 
-void CloseFrameBuffer(int fh)
-{
-    close(fh);
-}
 
     /*
-     *  Get the Variable Part of the Screen Info
+     *  Function Prototypes
      */
 
-void GetVarScreenInfo(int fh, struct fb_var_screeninfo *var)
-{
-    if (ioctl(fh, FBIOGET_VSCREENINFO, var))
-	Die("ioctl FBIOGET_VSCREENINFO: %s\n", strerror(errno));
-}
+static unsigned long long Nsecs(void);
+static void DisplayVModeInfo(FILE *out, struct VideoMode *vmode);
+static void DisplayFBInfo(FILE *out, struct fb_fix_screeninfo *fix);
+static void Usage(void) __attribute__ ((noreturn));
+static void ResetOptions(void);
+static const char *ParseOptions(int argc, char *argv[], int request);
+static struct FBSet *OpenDevice(const char *name, FILE *out);
+static int SetMode(struct FBSet *fs, struct VideoMode *vmode, int *changed);
+static int RunHeads(struct FBSet *modes, FILE *out);
+static int ProbeModes(struct FBSet *modes, struct FBSet *fs, FILE *out);
+static int BenchIoctls(struct FBSet *fs, FILE *out);
+static int BenchFlips(struct FBSet *fs, FILE *out);
+static int BenchMemory(struct FBSet *fs, FILE *out);
+static int DumpScreen(struct FBSet *fs, FILE *out);
+static int DrawPattern(struct FBSet *fs, FILE *out);
+static int RunCommand(struct FBSet *modes, FILE *out);
+static void PrintStats(FILE *f);
+static int RunBatch(const char *file);
+int main(int argc, char *argv[]);
 
 
     /*
-     *  Set (and Get) the Variable Part of the Screen Info
+     *  Monotonic Clock in Nanoseconds
      */
 
-void SetVarScreenInfo(int fh, struct fb_var_screeninfo *var)
+static unsigned long long Nsecs(void)
 {
-    if (ioctl(fh, FBIOPUT_VSCREENINFO, var))
-	Die("ioctl FBIOPUT_VSCREENINFO: %s\n", strerror(errno));
-}
-
+    struct timespec ts;
 
-    /*
-     *  Get the Fixed Part of the Screen Info
-     */
-
-void GetFixScreenInfo(int fh, struct fb_fix_screeninfo *fix)
-{
-    if (ioctl(fh, FBIOGET_FSCREENINFO, fix))
-	Die("ioctl FBIOGET_FSCREENINFO: %s\n", strerror(errno));
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL+ts.tv_nsec;
 }
 
 
     /*
-     *  Conversion Routines
+     *  Error Traps
      */
 
-static void ConvertFromVideoMode(const struct VideoMode *vmode,
-				 struct fb_var_screeninfo *var)
-{
-    memset(var, 0, sizeof(struct fb_var_screeninfo));
-    var->xres = vmode->xres;
-    var->yres = vmode->yres;
-    var->xres_virtual = vmode->vxres;
-    var->yres_virtual = vmode->vyres;
-    var->bits_per_pixel = vmode->depth;
-    var->nonstd = vmode->nonstd;
-    if (Opt_test)
-	var->activate = FB_ACTIVATE_TEST;
-    else
-	var->activate = FB_ACTIVATE_NOW;
-    if (Opt_all)
-	var->activate = FB_ACTIVATE_ALL;
-    var->accel_flags = vmode->accel_flags;
-    var->pixclock = vmode->pixclock;
-    var->left_margin = vmode->left;
-    var->right_margin = vmode->right;
-    var->upper_margin = vmode->upper;
-    var->lower_margin = vmode->lower;
-    var->hsync_len = vmode->hslen;
-    var->vsync_len = vmode->vslen;
-    if (vmode->hsync == HIGH)
-	var->sync |= FB_SYNC_HOR_HIGH_ACT;
-    if (vmode->vsync == HIGH)
-	var->sync |= FB_SYNC_VERT_HIGH_ACT;
-    if (vmode->csync == HIGH)
-	var->sync |= FB_SYNC_COMP_HIGH_ACT;
-    if (vmode->gsync == HIGH)
-	var->sync |= FB_SYNC_ON_GREEN;
-    if (vmode->extsync == TRUE)
-	var->sync |= FB_SYNC_EXT;
-    if (vmode->bcast == TRUE)
-	var->sync |= FB_SYNC_BROADCAST;
-    if (vmode->laced == TRUE)
-	var->vmode = FB_VMODE_INTERLACED;
-    else if (vmode->dblscan == TRUE)
-	var->vmode = FB_VMODE_DOUBLE;
-    else
-	var->vmode = FB_VMODE_NONINTERLACED;
-    var->vmode |= FB_VMODE_CONUPDATE;
-    var->red.length = vmode->red.length;
-    var->red.offset = vmode->red.offset;
-    var->green.length = vmode->green.length;
-    var->green.offset = vmode->green.offset;
-    var->blue.length = vmode->blue.length;
-    var->blue.offset = vmode->blue.offset;
-    var->transp.length = vmode->transp.length;
-    var->transp.offset = vmode->transp.offset;
-    var->grayscale = vmode->grayscale;
-}
-
-
-static void ConvertToVideoMode(const struct fb_var_screeninfo *var,
-			       struct VideoMode *vmode)
-{
-    vmode->name = NULL;
-    vmode->xres = var->xres;
-    vmode->yres = var->yres;
-    vmode->vxres = var->xres_virtual;
-    vmode->vyres = var->yres_virtual;
-    vmode->depth = var->bits_per_pixel;
-    vmode->nonstd = var->nonstd;
-    vmode->accel_flags = var->accel_flags;
-    vmode->pixclock = var->pixclock;
-    vmode->left = var->left_margin;
-    vmode->right = var->right_margin;
-    vmode->upper = var->upper_margin;
-    vmode->lower = var->lower_margin;
-    vmode->hslen = var->hsync_len;
-    vmode->vslen = var->vsync_len;
-    vmode->hsync = var->sync & FB_SYNC_HOR_HIGH_ACT ? HIGH : LOW;
-    vmode->vsync = var->sync & FB_SYNC_VERT_HIGH_ACT ? HIGH : LOW;
-    vmode->csync = var->sync & FB_SYNC_COMP_HIGH_ACT ? HIGH : LOW;
-    vmode->gsync = var->sync & FB_SYNC_ON_GREEN ? TRUE : FALSE;
-    vmode->extsync = var->sync & FB_SYNC_EXT ? TRUE : FALSE;
-    vmode->bcast = var->sync & FB_SYNC_BROADCAST ? TRUE : FALSE;
-    vmode->grayscale = var->grayscale;
-    vmode->laced = FALSE;
-    vmode->dblscan = FALSE;
-    switch (var->vmode & FB_VMODE_MASK) {
-	case FB_VMODE_INTERLACED:
-	    vmode->laced = TRUE;
-	    break;
-	case FB_VMODE_DOUBLE:
-	    vmode->dblscan = TRUE;
-	    break;
-    }
-    vmode->red.length = var->red.length;
-    vmode->red.offset = var->red.offset;
-    vmode->green.length = var->green.length;
-    vmode->green.offset = var->green.offset;
-    vmode->blue.length = var->blue.length;
-    vmode->blue.offset = var->blue.offset;
-    vmode->transp.length = var->transp.length;
-    vmode->transp.offset = var->transp.offset;
-    FillScanRates(vmode);
-}
-
+static __thread struct ErrorTrap *ErrorTraps = NULL;
 
-static int atoboolean(const char *var)
+void PushErrorTrap(struct ErrorTrap *trap)
 {
-    int value = 0;
-
-    if (!strcasecmp(var, "false") || !strcasecmp(var, "low") ||
-	!strcasecmp(var, "no") || !strcasecmp(var, "off") ||
-	!strcmp(var, "0"))
-	value = 0;
-    else if (!strcasecmp(var, "true") || !strcasecmp(var, "high") ||
-	     !strcasecmp(var, "yes") || !strcasecmp(var, "on") ||
-	     !strcmp(var, "1"))
-	value = 1;
-    else
-	Die("Invalid value `%s'\n", var);
-
-    return value;
+    trap->prev = ErrorTraps;
+    trap->msg[0] = '\0';
+    ErrorTraps = trap;
 }
 
 
-void AddVideoMode(const struct VideoMode *vmode)
+void PopErrorTrap(struct ErrorTrap *trap)
 {
-    struct VideoMode *vmode2;
-
-    if (FindVideoMode(vmode->name))
-	Die("%s:%d: Duplicate mode name `%s'\n", Opt_modedb, line,
-	    vmode->name);
-    vmode2 = malloc(sizeof(struct VideoMode));
-    *vmode2 = *vmode;
-    if (!FillScanRates(vmode2))
-	Die("%s:%d: Bad video mode `%s'\n", Opt_modedb, line, vmode2->name);
-    vmode2->next = VideoModes;
-    VideoModes = vmode2;
+    ErrorTraps = trap->prev;
 }
 
 
     /*
-     *  Read the Video Mode Database
+     *  Print an Error Message and Exit, or Unwind to the Innermost Trap
      */
 
-static void ReadModeDB(void)
-{
-    if (Opt_verbose)
-	printf("Reading mode database from file `%s'\n", Opt_modedb);
-
-    if (!(yyin = fopen(Opt_modedb, "r")))
-	Die("fopen %s: %s\n", Opt_modedb, strerror(errno));
-    yyparse();
-    fclose(yyin);
-}
-
-
-static void getColor(struct color *color, const char** opt)
+void Die(const char *fmt, ...)
 {
-    char* ptr;
-
-    color->length = 0;
-    color->offset = 0;
-    ptr = (char*)(*opt);
-    if (!ptr)
-	return;
-    color->length = strtoul(ptr, &ptr, 0);
-    if (!ptr)
-	return;
-    if (*ptr == '/')
-	color->offset = strtoul(ptr+1, &ptr, 0);
-    if (ptr) {
-	while (*ptr && isspace(*ptr))
-	    ptr++;
-	if (*ptr == ',') {
-	    ptr++;
-	} else if (*ptr)
-	    Die("Bad RGBA syntax, rL/rO,gL/gO,bL/bO,tL/tO or rL,gL,bL,tL\n");
+    struct ErrorTrap *trap = ErrorTraps;
+    va_list ap;
+    size_t len;
+
+    if (!trap) {
+	fflush(stdout);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	exit(1);
     }
-    *opt = ptr;
-    return;
-}
-
-void makeRGBA(struct VideoMode *vmode, const char* opt)
-{
-    getColor(&vmode->red, &opt);
-    getColor(&vmode->green, &opt);
-    getColor(&vmode->blue, &opt);
-    getColor(&vmode->transp, &opt);
-}
-
-    /*
-     *  Find a Video Mode
-     */
-
-static struct VideoMode *FindVideoMode(const char *name)
-{
-    struct VideoMode *vmode;
-
-    for (vmode = VideoModes; vmode; vmode = vmode->next)
-	if (!strcmp(name, vmode->name))
-	    break;
-
-    return vmode;
-}
-
 
-    /*
-     *  Modify a Video Mode
-     */
-
-static void ModifyVideoMode(struct VideoMode *vmode)
-{
-    u_int hstep = 8, vstep = 2;
-
-    if (Opt_xres)
-	vmode->xres = strtoul(Opt_xres, NULL, 0);
-    if (Opt_yres)
-	vmode->yres = strtoul(Opt_yres, NULL, 0);
-    if (Opt_vxres)
-	vmode->vxres = strtoul(Opt_vxres, NULL, 0);
-    if (Opt_vyres)
-	vmode->vyres = strtoul(Opt_vyres, NULL, 0);
-    if (Opt_depth)
-	vmode->depth = strtoul(Opt_depth, NULL, 0);
-    if (Opt_nonstd)
-	vmode->nonstd = strtoul(Opt_nonstd, NULL, 0);
-    if (Opt_accel)
-	vmode->accel_flags = atoboolean(Opt_accel) ? FB_ACCELF_TEXT : 0;
-    if (Opt_pixclock)
-	vmode->pixclock = strtoul(Opt_pixclock, NULL, 0);
-    if (Opt_left)
-	vmode->left = strtoul(Opt_left, NULL, 0);
-    if (Opt_right)
-	vmode->right = strtoul(Opt_right, NULL, 0);
-    if (Opt_upper)
-	vmode->upper = strtoul(Opt_upper, NULL, 0);
-    if (Opt_lower)
-	vmode->lower = strtoul(Opt_lower, NULL, 0);
-    if (Opt_hslen)
-	vmode->hslen = strtoul(Opt_hslen, NULL, 0);
-    if (Opt_vslen)
-	vmode->vslen = strtoul(Opt_vslen, NULL, 0);
-    if (Opt_hsync)
-	vmode->hsync = atoboolean(Opt_hsync);
-    if (Opt_vsync)
-	vmode->vsync = atoboolean(Opt_vsync);
-    if (Opt_csync)
-	vmode->csync = atoboolean(Opt_csync);
-    if (Opt_gsync)
-	vmode->gsync = atoboolean(Opt_gsync);
-    if (Opt_extsync)
-	vmode->extsync = atoboolean(Opt_extsync);
-    if (Opt_bcast)
-	vmode->bcast = atoboolean(Opt_bcast);
-    if (Opt_laced)
-	vmode->laced = atoboolean(Opt_laced);
-    if (Opt_double)
-	vmode->dblscan = atoboolean(Opt_double);
-    if (Opt_grayscale)
-	vmode->grayscale = atoboolean(Opt_grayscale);
-    if (Opt_step)
-	hstep = vstep = strtoul(Opt_step, NULL, 0);
-    if (Opt_matchyres)
-        vmode->vyres = vmode->yres;
-    if (Opt_move) {
-	if (!strcasecmp(Opt_move, "left")) {
-	    if (hstep > vmode->left)
-		Die("The left margin cannot be negative\n");
-	    vmode->left -= hstep;
-	    vmode->right += hstep;
-	} else if (!strcasecmp(Opt_move, "right")) {
-	    if (hstep > vmode->right)
-		Die("The right margin cannot be negative\n");
-	    vmode->left += hstep;
-	    vmode->right -= hstep;
-	} else if (!strcasecmp(Opt_move, "up")) {
-	    if (vstep > vmode->upper)
-		Die("The upper margin cannot be negative\n");
-	    vmode->upper -= vstep;
-	    vmode->lower += vstep;
-	} else if (!strcasecmp(Opt_move, "down")) {
-	    if (vstep > vmode->lower)
-		Die("The lower margin cannot be negative\n");
-	    vmode->upper += vstep;
-	    vmode->lower -= vstep;
-	} else
-	    Die("Invalid direction `%s'\n", Opt_move);
-    }
-    if (Opt_rgba) {
-	makeRGBA(vmode, Opt_rgba);
-    }
-    if (!FillScanRates(vmode))
-	Die("Bad video mode\n");
+    va_start(ap, fmt);
+    vsnprintf(trap->msg, sizeof(trap->msg), fmt, ap);
+    va_end(ap);
+    len = strlen(trap->msg);
+    if (len && trap->msg[len-1] == '\n')
+	trap->msg[len-1] = '\0';
+    ErrorTraps = trap->prev;
+    longjmp(trap->env, 1);
 }
 
 
@@ -609,94 +334,96 @@ static void ModifyVideoMode(struct VideoMode *vmode)
      *  Display the Video Mode Information
      */
 
-static void DisplayVModeInfo(struct VideoMode *vmode)
+static void DisplayVModeInfo(FILE *out, struct VideoMode *vmode)
 {
+    unsigned long long start = Nsecs();
     u_int res, sstart, send, total;
 
-    puts("");
+    fputs("\n", out);
     if (!Opt_xfree86) {
-	printf("mode \"%dx%d", vmode->xres, vmode->yres);
+	fprintf(out, "mode \"%dx%d", vmode->xres, vmode->yres);
 	if (vmode->pixclock) {
-	    printf("-%d\"\n", (int)(vmode->vrate+0.5));
-	    printf("    # D: %5.3f MHz, H: %5.3f kHz, V: %5.3f Hz\n",
-		   vmode->drate/1E6, vmode->hrate/1E3, vmode->vrate);
+	    fprintf(out, "-%d\"\n", (int)(vmode->vrate+0.5));
+	    fprintf(out, "    # D: %5.3f MHz, H: %5.3f kHz, V: %5.3f Hz\n",
+			 vmode->drate/1E6, vmode->hrate/1E3, vmode->vrate);
 	} else
-	    puts("\"");
-	printf("    geometry %d %d %d %d %d\n", vmode->xres, vmode->yres,
-	       vmode->vxres, vmode->vyres, vmode->depth);
-	printf("    timings %d %d %d %d %d %d %d\n", vmode->pixclock,
-	       vmode->left, vmode->right, vmode->upper, vmode->lower,
-	       vmode->hslen, vmode->vslen);
+	    fputs("\"\n", out);
+	fprintf(out, "    geometry %d %d %d %d %d\n", vmode->xres, vmode->yres,
+		     vmode->vxres, vmode->vyres, vmode->depth);
+	fprintf(out, "    timings %d %d %d %d %d %d %d\n", vmode->pixclock,
+		     vmode->left, vmode->right, vmode->upper, vmode->lower,
+		     vmode->hslen, vmode->vslen);
 	if (vmode->hsync)
-	    puts("    hsync high");
+	    fputs("    hsync high\n", out);
 	if (vmode->vsync)
-	    puts("    vsync high");
+	    fputs("    vsync high\n", out);
 	if (vmode->csync)
-	    puts("    csync high");
+	    fputs("    csync high\n", out);
 	if (vmode->gsync)
-	    puts("    gsync true");
+	    fputs("    gsync true\n", out);
 	if (vmode->extsync)
-	    puts("    extsync true");
+	    fputs("    extsync true\n", out);
 	if (vmode->bcast)
-	    puts("    bcast true");
+	    fputs("    bcast true\n", out);
 	if (vmode->laced)
-	    puts("    laced true");
+	    fputs("    laced true\n", out);
 	if (vmode->dblscan)
-	    puts("    double true");
+	    fputs("    double true\n", out);
 	if (vmode->nonstd)
-            printf("    nonstd %u\n", vmode->nonstd);
+            fprintf(out, "    nonstd %u\n", vmode->nonstd);
 	if (vmode->accel_flags)
-	    puts("    accel true");
+	    fputs("    accel true\n", out);
 	if (vmode->grayscale)
-	    puts("    grayscale true");
-	printf("    rgba %u/%u,%u/%u,%u/%u,%u/%u\n",
+	    fputs("    grayscale true\n", out);
+	fprintf(out, "    rgba %u/%u,%u/%u,%u/%u,%u/%u\n",
 	    vmode->red.length, vmode->red.offset, vmode->green.length,
 	    vmode->green.offset, vmode->blue.length, vmode->blue.offset,
 	    vmode->transp.length, vmode->transp.offset);
-	puts("endmode\n");
+	fputs("endmode\n\n", out);
     } else {
-	printf("Mode \"%dx%d\"\n", vmode->xres, vmode->yres);
+	fprintf(out, "Mode \"%dx%d\"\n", vmode->xres, vmode->yres);
 	if (vmode->pixclock) {
-	    printf("    # D: %5.3f MHz, H: %5.3f kHz, V: %5.3f Hz\n",
-		   vmode->drate/1E6, vmode->hrate/1E3, vmode->vrate);
-	    printf("    DotClock %5.3f\n", vmode->drate/1E6+0.001);
+	    fprintf(out, "    # D: %5.3f MHz, H: %5.3f kHz, V: %5.3f Hz\n",
+			 vmode->drate/1E6, vmode->hrate/1E3, vmode->vrate);
+	    fprintf(out, "    DotClock %5.3f\n", vmode->drate/1E6+0.001);
 	} else
-	    puts("    DotClock Unknown");
+	    fputs("    DotClock Unknown\n", out);
 	res = vmode->xres;
 	sstart = res+vmode->right;
 	send = sstart+vmode->hslen;
 	total = send+vmode->left;
-	printf("    HTimings %d %d %d %d\n", res, sstart, send, total);
+	fprintf(out, "    HTimings %d %d %d %d\n", res, sstart, send, total);
 	res = vmode->yres;
 	sstart = res+vmode->lower;
 	send = sstart+vmode->vslen;
 	total = send+vmode->upper;
-	printf("    VTimings %d %d %d %d\n", res, sstart, send, total);
-	printf("    Flags   ");
+	fprintf(out, "    VTimings %d %d %d %d\n", res, sstart, send, total);
+	fprintf(out, "    Flags   ");
 	if (vmode->laced)
-	    printf(" \"Interlace\"");
+	    fprintf(out, " \"Interlace\"");
 	if (vmode->dblscan)
-	    printf(" \"DoubleScan\"");
+	    fprintf(out, " \"DoubleScan\"");
 	if (vmode->hsync)
-	    printf(" \"+HSync\"");
+	    fprintf(out, " \"+HSync\"");
 	else
-	    printf(" \"-HSync\"");
+	    fprintf(out, " \"-HSync\"");
 	if (vmode->vsync)
-	    printf(" \"+VSync\"");
+	    fprintf(out, " \"+VSync\"");
 	else
-	    printf(" \"-VSync\"");
+	    fprintf(out, " \"-VSync\"");
 	if (vmode->csync)
-	    printf(" \"Composite\"");
+	    fprintf(out, " \"Composite\"");
 	if (vmode->extsync)
-	    puts("    # Warning: XFree86 doesn't support extsync\n");
+	    fputs("    # Warning: XFree86 doesn't support extsync\n\n", out);
 	if (vmode->bcast)
-	    printf(" \"bcast\"");
+	    fprintf(out, " \"bcast\"");
 	if (vmode->accel_flags)
-	    puts("    # Warning: XFree86 doesn't support accel\n");
+	    fputs("    # Warning: XFree86 doesn't support accel\n\n", out);
 	if (vmode->grayscale)
-	    puts("    # Warning: XFree86 doesn't support grayscale\n");
-	puts("\nEndMode\n");
+	    fputs("    # Warning: XFree86 doesn't support grayscale\n\n", out);
+	fputs("\nEndMode\n\n", out);
     }
+    DisplayNsecs += Nsecs()-start;
 }
 
 
@@ -704,34 +431,35 @@ static void DisplayVModeInfo(struct VideoMode *vmode)
      *  Display the Frame Buffer Device Information
      */
 
-static void DisplayFBInfo(struct fb_fix_screeninfo *fix)
+static void DisplayFBInfo(FILE *out, struct fb_fix_screeninfo *fix)
 {
+    unsigned long long start = Nsecs();
     int i;
 
-    puts("Frame buffer device information:");
-    printf("    Name        : %s\n", fix->id);
-    printf("    Address     : %p\n", fix->smem_start);
-    printf("    Size        : %d\n", fix->smem_len);
-    printf("    Type        : ");
+    fputs("Frame buffer device information:\n", out);
+    fprintf(out, "    Name        : %s\n", fix->id);
+    fprintf(out, "    Address     : %p\n", fix->smem_start);
+    fprintf(out, "    Size        : %d\n", fix->smem_len);
+    fprintf(out, "    Type        : ");
     switch (fix->type) {
 	case FB_TYPE_PACKED_PIXELS:
-	    puts("PACKED PIXELS");
+	    fputs("PACKED PIXELS\n", out);
 	    break;
 	case FB_TYPE_PLANES:
-	    puts("PLANES");
+	    fputs("PLANES\n", out);
 	    break;
 	case FB_TYPE_INTERLEAVED_PLANES:
-	    printf("INTERLEAVED PLANES (%d bytes interleave)\n",
-		   fix->type_aux);
+	    fprintf(out, "INTERLEAVED PLANES (%d bytes interleave)\n",
+			 fix->type_aux);
 	    break;
 	case FB_TYPE_TEXT:
 	    for (i = 0; i < sizeof(Textmodes)/sizeof(*Textmodes); i++)
 		if (fix->type_aux == Textmodes[i].id)
 		    break;
 	    if (i < sizeof(Textmodes)/sizeof(*Textmodes))
-		puts(Textmodes[i].name);
+		fprintf(out, "%s\n", Textmodes[i].name);
 	    else
-		printf("Unknown text (%d)\n", fix->type_aux);
+		fprintf(out, "Unknown text (%d)\n", fix->type_aux);
 	    break;
 	case FB_TYPE_VGA_PLANES:
 	    {
@@ -741,87 +469,57 @@ static void DisplayFBInfo(struct fb_fix_screeninfo *fix)
 		    if (fix->type_aux == t->id)
 		    	break;
 		if (t->name)
-		    puts(t->name);
+		    fprintf(out, "%s\n", t->name);
 		else
-	            printf("Unknown VGA mode (%d)\n", fix->type_aux);
+	            fprintf(out, "Unknown VGA mode (%d)\n", fix->type_aux);
 	    }
 	    break;
 	default:
-	    printf("%d (UNKNOWN)\n", fix->type);
-	    printf("    Type_aux    : %d\n", fix->type_aux);
+	    fprintf(out, "%d (UNKNOWN)\n", fix->type);
+	    fprintf(out, "    Type_aux    : %d\n", fix->type_aux);
 	    break;
     }
-    printf("    Visual      : ");
+    fprintf(out, "    Visual      : ");
     switch (fix->visual) {
 	case FB_VISUAL_MONO01:
-	    puts("MONO01");
+	    fputs("MONO01\n", out);
 	    break;
 	case FB_VISUAL_MONO10:
-	    puts("MONO10");
+	    fputs("MONO10\n", out);
 	    break;
 	case FB_VISUAL_TRUECOLOR:
-	    puts("TRUECOLOR");
+	    fputs("TRUECOLOR\n", out);
 	    break;
 	case FB_VISUAL_PSEUDOCOLOR:
-	    puts("PSEUDOCOLOR");
+	    fputs("PSEUDOCOLOR\n", out);
 	    break;
 	case FB_VISUAL_DIRECTCOLOR:
-	    puts("DIRECTCOLOR");
+	    fputs("DIRECTCOLOR\n", out);
 	    break;
 	case FB_VISUAL_STATIC_PSEUDOCOLOR:
-	    puts("STATIC PSEUDOCOLOR");
+	    fputs("STATIC PSEUDOCOLOR\n", out);
 	    break;
 	default:
-	    printf("%d (UNKNOWN)\n", fix->visual);
+	    fprintf(out, "%d (UNKNOWN)\n", fix->visual);
 	    break;
     }
-    printf("    XPanStep    : %d\n", fix->xpanstep);
-    printf("    YPanStep    : %d\n", fix->ypanstep);
-    printf("    YWrapStep   : %d\n", fix->ywrapstep);
-    printf("    LineLength  : %d\n", fix->line_length);
+    fprintf(out, "    XPanStep    : %d\n", fix->xpanstep);
+    fprintf(out, "    YPanStep    : %d\n", fix->ypanstep);
+    fprintf(out, "    YWrapStep   : %d\n", fix->ywrapstep);
+    fprintf(out, "    LineLength  : %d\n", fix->line_length);
     if (fix->mmio_len) {
-	printf("    MMIO Address: %p\n", fix->mmio_start);
-	printf("    MMIO Size   : %d\n", fix->mmio_len);
+	fprintf(out, "    MMIO Address: %p\n", fix->mmio_start);
+	fprintf(out, "    MMIO Size   : %d\n", fix->mmio_len);
     }
-    printf("    Accelerator : ");
+    fprintf(out, "    Accelerator : ");
     for (i = 0; i < sizeof(Accelerators)/sizeof(*Accelerators); i++)
 	if (fix->accel == Accelerators[i].id)
 	    break;
     if (i < sizeof(Accelerators)/sizeof(*Accelerators))
-	puts(Accelerators[i].name);
+	fprintf(out, "%s\n", Accelerators[i].name);
     else
-	printf("Unknown (%d)\n", fix->accel);
-}
-
-
-    /*
-     *  Calculate the Scan Rates for a Video Mode
-     */
-
-static int FillScanRates(struct VideoMode *vmode)
-{
-    u_int htotal = vmode->left+vmode->xres+vmode->right+vmode->hslen;
-    u_int vtotal = vmode->upper+vmode->yres+vmode->lower+vmode->vslen;
-
-    if (vmode->dblscan)
-	vtotal <<= 2;
-    else if (!vmode->laced)
-	vtotal <<= 1;
-
-    if (!htotal || !vtotal)
-	return 0;
-
-    if (vmode->pixclock) {
-	vmode->drate = 1E12/vmode->pixclock;
-	vmode->hrate = vmode->drate/htotal;
-	vmode->vrate = vmode->hrate/vtotal*2;
-    } else {
-	vmode->drate = 0;
-	vmode->hrate = 0;
-	vmode->vrate = 0;
-    }
-
-    return 1;
+	fprintf(out, "Unknown (%d)\n", fix->accel);
+    DisplayNsecs += Nsecs()-start;
 }
 
 
@@ -843,13 +541,43 @@ static void Usage(void)
 	"    -v, --verbose      : verbose mode\n"
 	"    -V, --version      : print version information\n"
 	"    -x, --xfree86      : XFree86 compatibility mode\n"
+	"    --probe-all        : test every video mode of the database on the\n"
+	"                         device\n"
+	"    --noprobecache     : always ask the driver whether a mode is valid\n"
+	"                         (results are cached in " DEFAULT_PROBECACHE ")\n"
 	"    -a, --all          : change all virtual consoles on this device\n"
+	"    --force            : set the video mode even if it is active "
+				 "already\n"
+	"    --status           : exit with status 2 if no video mode was "
+				 "set\n"
+	"    --stats            : print how long each step took, and figures\n"
+	"                         of the video mode database, to stderr\n"
+	"    --bench-ioctl <n>  : time n calls of each ioctl of the device\n"
+	"    --bench-pan        : with --bench-ioctl, also time panning\n"
+	"    --bench-flip <n>   : flip n times between two buffers by panning\n"
+	"    --bench-mem <n>    : time writing, reading and copying the frame\n"
+	"                         buffer memory, with 1 and with n threads\n"
+	"    --dump <file>      : save the screen as a .ppm or .png image\n"
+	"    --pattern <name>   : draw bars, grid, ramp or solid on the screen\n"
 	"  Frame buffer special device nodes:\n"
 	"    -fb <device>       : processed frame buffer device\n"
 	"                         (default is " DEFAULT_FRAMEBUFFER ")\n"
+	"    -fb <dev>,<dev>... : several devices, also as patterns such as\n"
+	"                         '/dev/fb[0-7]', all set at the same time\n"
+	"    --barrier          : with several devices, let them all get ready\n"
+	"                         before any is set\n"
+	"    --transaction      : set all devices or none, restoring the others\n"
+	"                         if one fails\n"
 	"  Video mode database:\n"
-	"    -db <file>         : video mode database file\n"
-	"                         (default is " DEFAULT_MODEDBFILE ")\n"
+	"    -db <file>         : video mode database file or directory\n"
+	"                         (default is " DEFAULT_MODEDBFILE " and\n"
+	"                         " DEFAULT_MODEDBDIR ")\n"
+	"    -cache <file>      : compiled video mode database file\n"
+	"                         (default is " DEFAULT_MODECACHE ", or\n"
+	"                         /var/cache/fb.modes-<hash>.bin with -db)\n"
+	"    --nocache          : don't use the compiled video mode database\n"
+	"    --strict           : parse and check the whole video mode "
+				 "database\n"
 	"  Display geometry:\n"
 	"    -xres <value>      : horizontal resolution (in pixels)\n"
 	"    -yres <value>      : vertical resolution (in pixels)\n"
@@ -859,6 +587,8 @@ static void Usage(void)
 	"    -nonstd <value>    : select nonstandard video mode\n"
 	"    -g, --geometry ... : set all geometry parameters at once\n"
 	"    -match             : set virtual vertical resolution by virtual resolution\n"
+	"    -buffers <n>       : set virtual vertical resolution for n buffers\n"
+	"                         (or max), as the video memory allows\n"
 	"  Display timings:\n"
 	"    -pixclock <value>  : pixel clock (in picoseconds)\n"
 	"    -left <value>      : left margin (in pixels)\n"
@@ -885,32 +615,76 @@ static void Usage(void)
 	"    -move <direction>  : move the visible part (left, right, up or "
 				 "down)\n"
 	"    -step <value>      : step increment (in pixels or pixel lines)\n"
-	"                         (default is 8 horizontal, 2 vertical)\n",
+	"                         (default is 8 horizontal, 2 vertical)\n"
+	"  Batch:\n"
+	"    --batch <file>     : run the commands in file (- for stdin), one\n"
+	"                         per line, with one database and each device\n"
+	"                         opened only once\n"
+	"  Daemon:\n"
+	"    --daemon           : keep the database and devices open and serve\n"
+	"                         requests on a UNIX domain socket\n"
+	"    --client           : let the daemon run this command\n"
+	"    --socket <file>    : socket of the daemon\n"
+	"                         (default is " DEFAULT_SOCKET ")\n",
 	ProgramName);
 }
 
 
     /*
-     *  Main Routine
+     *  Reset the Options a Request may give
+     *
+     *  The others concern the video mode database or the daemon itself, and
+     *  keep the values the daemon was started with.
      */
 
-int main(int argc, char *argv[])
+static void ResetOptions(void)
 {
-    struct VideoMode *vmode;
-    struct fb_var_screeninfo var;
-    struct fb_fix_screeninfo fix;
-    int fh = -1, i;
+    Opt_test = 0;
+    Opt_show = 0;
+    Opt_info = 0;
+    Opt_version = 0;
+    Opt_verbose = 0;
+    Opt_xfree86 = 0;
+    Opt_change = 0;
+    Opt_all = 0;
+    Opt_force = 0;
+    Opt_status = 0;
+    Opt_barrier = 0;
+    Opt_transaction = 0;
+    Opt_probe = 0;
+    Opt_noprobecache = 0;
+    Opt_stats = 0;
+    Opt_benchpan = 0;
+    Opt_fb = NULL;
+    Opt_bench = NULL;
+    Opt_benchflip = NULL;
+    Opt_benchmem = NULL;
+    Opt_dump = NULL;
+    Opt_pattern = NULL;
+    Opt_modename = NULL;
+    memset(&Opt_modify, 0, sizeof(Opt_modify));
+}
 
-    ProgramName = argv[0];
 
     /*
      *  Parse the Options
+     *
+     *  argv[0] is skipped. Returns NULL, or the argument that is wrong or
+     *  not allowed in a request.
      */
 
+static const char *ParseOptions(int argc, char *argv[], int request)
+{
+    int i;
+
     while (--argc > 0) {
 	argv++;
+	if (request)
+	    for (i = 0; ServerOptions[i]; i++)
+		if (!strcmp(argv[0], ServerOptions[i]))
+		    return argv[0];
 	if (!strcmp(argv[0], "-h") || !strcmp(argv[0], "--help"))
-	    Usage();
+	    return argv[0];
 	else if (!strcmp(argv[0], "-v") || !strcmp(argv[0], "--verbose"))
 	    Opt_verbose = 1;
 	else if (!strcmp(argv[0], "-V") || !strcmp(argv[0], "--version"))
@@ -926,34 +700,58 @@ int main(int argc, char *argv[])
 	    Opt_xfree86 = 1;
 	else if (!strcmp(argv[0], "-a") || !strcmp(argv[0], "--all"))
 	    Opt_all = 1;
+	else if (!strcmp(argv[0], "--nocache"))
+	    Opt_modecache = NULL;
+	else if (!strcmp(argv[0], "--strict"))
+	    Opt_strict = 1;
+	else if (!strcmp(argv[0], "--force"))
+	    Opt_force = 1;
+	else if (!strcmp(argv[0], "--status"))
+	    Opt_status = 1;
+	else if (!strcmp(argv[0], "--barrier"))
+	    Opt_barrier = 1;
+	else if (!strcmp(argv[0], "--transaction"))
+	    Opt_transaction = 1;
+	else if (!strcmp(argv[0], "--probe-all"))
+	    Opt_probe = 1;
+	else if (!strcmp(argv[0], "--noprobecache"))
+	    Opt_noprobecache = 1;
+	else if (!strcmp(argv[0], "--stats"))
+	    Opt_stats = 1;
+	else if (!strcmp(argv[0], "--bench-pan"))
+	    Opt_benchpan = 1;
+	else if (!strcmp(argv[0], "--daemon"))
+	    Opt_daemon = 1;
+	else if (!strcmp(argv[0], "--client"))
+	    Opt_client = 1;
 	else if (!strcmp(argv[0], "-g") || !strcmp(argv[0], "--geometry")) {
 	    if (argc > 5) {
-		Opt_xres = argv[1];
-		Opt_yres = argv[2];
-		Opt_vxres = argv[3];
-		Opt_vyres = argv[4];
-		Opt_depth = argv[5];
+		Opt_modify.xres = argv[1];
+		Opt_modify.yres = argv[2];
+		Opt_modify.vxres = argv[3];
+		Opt_modify.vyres = argv[4];
+		Opt_modify.depth = argv[5];
 		Opt_change = 1;
 		argc -= 5;
 		argv += 5;
 	    } else
-		Usage();
+		return argv[0];
 	} else if (!strcmp(argv[0], "-t") || !strcmp(argv[0], "--timings")) {
 	    if (argc > 7) {
-		Opt_pixclock = argv[1];
-		Opt_left = argv[2];
-		Opt_right = argv[3];
-		Opt_upper = argv[4];
-		Opt_lower = argv[5];
-		Opt_hslen = argv[6];
-		Opt_vslen = argv[7];
+		Opt_modify.pixclock = argv[1];
+		Opt_modify.left = argv[2];
+		Opt_modify.right = argv[3];
+		Opt_modify.upper = argv[4];
+		Opt_modify.lower = argv[5];
+		Opt_modify.hslen = argv[6];
+		Opt_modify.vslen = argv[7];
 		Opt_change = 1;
 		argc -= 7;
 		argv += 7;
 	    } else
-		Usage();
+		return argv[0];
 	} else if (!strcmp(argv[0], "-match")) {
-	    Opt_matchyres = argv[0];
+	    Opt_modify.matchyres = 1;
 	    Opt_change = 1;
 	} else {
 	    for (i = 0; Options[i].name; i++)
@@ -965,90 +763,1694 @@ int main(int argc, char *argv[])
 		    Opt_change |= Options[i].change;
 		    argv++;
 		} else
-		    Usage();
+		    return argv[0];
 	    } else if (!Opt_modename) {
 		Opt_modename = argv[0];
 		Opt_change = 1;
 	    } else
-		Usage();
+		return argv[0];
 	}
     }
+    return NULL;
+}
 
-    if (Opt_version || Opt_verbose)
-	puts(VERSION);
 
-    if (!Opt_fb)
-	Opt_fb = DEFAULT_FRAMEBUFFER;
+    /*
+     *  Open a Frame Buffer Device
+     *
+     *  Devices stay open until CloseDevices(), so the daemon opens each one
+     *  only once. Verbose messages go to out.
+     */
+
+static struct FBSet *OpenDevice(const char *name, FILE *out)
+{
+    struct Device *dev;
+    struct FBSet *fs;
+    char msg[512];
+
+    for (dev = Devices; dev; dev = dev->next)
+	if (!strcmp(dev->name, name)) {
+	    FBSetVerbose(dev->fs, Opt_verbose ? out : NULL);
+	    if (FBSetProbeCache(dev->fs,
+				Opt_noprobecache ? NULL : DEFAULT_PROBECACHE))
+		Die("%s\n", FBSetErrorMessage(dev->fs));
+	    return dev->fs;
+	}
+
+    if (!(fs = FBSetCreate()))
+	Die("No memory\n");
+    FBSetVerbose(fs, Opt_verbose ? out : NULL);
+    if (FBSetProbeCache(fs, Opt_noprobecache ? NULL : DEFAULT_PROBECACHE) ||
+	FBSetOpenDevice(fs, name)) {
+	snprintf(msg, sizeof(msg), "%s", FBSetErrorMessage(fs));
+	FBSetDestroy(fs);
+	Die("%s\n", msg);
+    }
+    if (!(dev = malloc(sizeof(*dev)+strlen(name)))) {
+	FBSetDestroy(fs);
+	Die("No memory\n");
+    }
+    strcpy(dev->name, name);
+    dev->fs = fs;
+    dev->next = Devices;
+    Devices = dev;
+    return fs;
+}
+
 
     /*
-     *  Open the Frame Buffer Device
+     *  Close all Frame Buffer Devices
      */
 
-    fh = OpenFrameBuffer(Opt_fb);
+void CloseDevices(void)
+{
+    struct Device *dev;
+
+    while ((dev = Devices)) {
+	Devices = dev->next;
+	FBSetDestroy(dev->fs);
+	free(dev);
+    }
+}
+
 
     /*
-     *  Get the Video Mode
+     *  Set the Video Mode of a Device, unless it is active already
+     *
+     *  Returns a library error code; changed tells whether the mode was set.
      */
 
-    if (Opt_modename) {
+static int SetMode(struct FBSet *fs, struct VideoMode *vmode, int *changed)
+{
+    __u32 activate;
+    int res;
+
+    activate = Opt_all ? FB_ACTIVATE_ALL :
+	       Opt_test ? FB_ACTIVATE_TEST : FB_ACTIVATE_NOW;
+    if (!Opt_force)
+	return FBSetUpdateMode(fs, vmode, activate, changed);
+    res = FBSetApplyMode(fs, vmode, activate);
+    *changed = !res && !Opt_test;
+    return res;
+}
 
-	/*
-	 *  Read the Video Mode Database
-	 */
 
-	ReadModeDB();
+    /*
+     *  Several Frame Buffer Devices
+     *
+     *  Every device gets a thread to set its video mode, so the displays
+     *  switch at the same time instead of one after the other. With
+     *  --barrier, the threads wait at a closed gate until all of them are
+     *  ready.
+     *
+     *  With --transaction, either all devices get the new video mode or none
+     *  does: every device tests it first, and if setting it fails on one
+     *  device, the others get their old video mode back.
+     */
+
+struct Head {
+    const char *name;
+    struct FBSet *fs;
+    struct VideoMode vmode;
+    struct fb_var_screeninfo saved;	/* to roll back to */
+    pthread_t thread;
+    int started;
+    int failed;
+    int changed;
+    int restored;			/* 1 if rolled back, -1 if that failed */
+    long usecs;
+    char msg[MAX_MESSAGE];
+};
 
-	if (!(vmode = FindVideoMode(Opt_modename)))
-	    Die("Unknown video mode `%s'\n", Opt_modename);      
+static pthread_mutex_t GateLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t GateOpen = PTHREAD_COND_INITIALIZER;
+static int GateClosed = 0;
 
-	Current = *vmode;
-	if (Opt_verbose)
-	    printf("Using video mode `%s'\n", Opt_modename);
-    } else {
-	GetVarScreenInfo(fh, &var);
-	ConvertToVideoMode(&var, &Current);
-	if (Opt_verbose)
-	    printf("Using current video mode from `%s'\n", Opt_fb);
+
+static void *SetHeadMode(void *arg)
+{
+    struct Head *head = arg;
+    struct timespec t0, t1;
+
+    pthread_mutex_lock(&GateLock);
+    while (GateClosed)
+	pthread_cond_wait(&GateOpen, &GateLock);
+    pthread_mutex_unlock(&GateLock);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    head->failed = SetMode(head->fs, &head->vmode, &head->changed) != FBSET_OK;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    head->usecs = (t1.tv_sec-t0.tv_sec)*1000000+
+		  (t1.tv_nsec-t0.tv_nsec)/1000;
+    if (head->failed)
+	snprintf(head->msg, sizeof(head->msg), "%s",
+		 FBSetErrorMessage(head->fs));
+    return NULL;
+}
+
+
+static void *TestHeadMode(void *arg)
+{
+    struct Head *head = arg;
+    struct VideoMode vmode = head->vmode;
+
+    if (FBSetApplyMode(head->fs, &vmode, FB_ACTIVATE_TEST)) {
+	snprintf(head->msg, sizeof(head->msg), "%s",
+		 FBSetErrorMessage(head->fs));
+	head->failed = 1;
+    }
+    return NULL;
+}
+
+
+static void *RestoreHeadMode(void *arg)
+{
+    struct Head *head = arg;
+    struct fb_var_screeninfo var = head->saved;
+
+    if (!head->changed)
+	return NULL;
+    var.activate = Opt_all ? FB_ACTIVATE_ALL : FB_ACTIVATE_NOW;
+    if (FBSetPutVar(head->fs, &var)) {
+	snprintf(head->msg, sizeof(head->msg), "%s",
+		 FBSetErrorMessage(head->fs));
+	head->restored = -1;
+	return NULL;
     }
+    FBSetConvertToVideoMode(&var, &head->vmode);
+    head->restored = 1;
+    head->changed = 0;
+    return NULL;
+}
 
-    if (Opt_change) {
 
-	/*
-	 *  Optionally Modify the Video Mode
-	 */
+    /*
+     *  Run a Job for every Device that has not failed, each in a Thread
+     *
+     *  Returns the number of devices that failed, now or before.
+     */
+
+static int RunThreads(struct Head *heads, int n, void *(*job)(void *))
+{
+    struct Head *head;
+    int i, failed = 0;
+
+    GateClosed = Opt_barrier;
+    for (i = 0; i < n; i++) {
+	head = &heads[i];
+	if (head->failed)
+	    continue;
+	if (pthread_create(&head->thread, NULL, job, head)) {
+	    strcpy(head->msg, "Cannot create a thread");
+	    head->failed = 1;
+	} else
+	    head->started = 1;
+    }
+    pthread_mutex_lock(&GateLock);
+    GateClosed = 0;
+    pthread_cond_broadcast(&GateOpen);
+    pthread_mutex_unlock(&GateLock);
+
+    for (i = 0; i < n; i++) {
+	head = &heads[i];
+	if (head->started)
+	    pthread_join(head->thread, NULL);
+	head->started = 0;
+	failed += head->failed;
+    }
+    return failed;
+}
 
-	ModifyVideoMode(&Current);
 
-	/*
-	 *  Set the Video Mode
-	 */
+    /*
+     *  Expand the List of Devices given to -fb
+     *
+     *  The list is separated by commas, and may contain shell patterns.
+     *  Names that appear twice are dropped.
+     */
+
+static struct Head *FindHeads(const char *spec, int *nheads)
+{
+    struct Head *heads;
+    char *list, *s;
+    glob_t g;
+    int flags = GLOB_NOCHECK, res = 0, n = 0, i, j;
+
+    if (!(list = strdup(spec)))
+	Die("No memory\n");
+    for (s = strtok(list, ","); s && !res; s = strtok(NULL, ",")) {
+	res = glob(s, flags, NULL, &g);
+	flags |= GLOB_APPEND;
+    }
+    free(list);
+    if (res || flags == GLOB_NOCHECK) {
+	if (flags != GLOB_NOCHECK)
+	    globfree(&g);
+	Die("Bad frame buffer device list `%s'\n", spec);
+    }
+
+    if (!(heads = calloc(g.gl_pathc, sizeof(*heads)))) {
+	globfree(&g);
+	Die("No memory\n");
+    }
+    for (i = 0; i < g.gl_pathc; i++) {
+	for (j = 0; j < n; j++)
+	    if (!strcmp(heads[j].name, g.gl_pathv[i]))
+		break;
+	if (j == n && !(heads[n++].name = strdup(g.gl_pathv[i]))) {
+	    while (n--)
+		free((char *)heads[n].name);
+	    free(heads);
+	    globfree(&g);
+	    Die("No memory\n");
+	}
+    }
+    globfree(&g);
+    *nheads = n;
+    return heads;
+}
+
+
+    /*
+     *  Run a Command on several Devices
+     *
+     *  What goes wrong with a device is reported with the device, and the
+     *  others carry on. The status of all devices ends up in one table.
+     */
+
+static int RunHeads(struct FBSet *modes, FILE *out)
+{
+    struct fb_fix_screeninfo fix;
+    struct ErrorTrap trap;
+    struct VideoMode vmode;
+    struct Head *heads, *head;
+    const char *status, *outcome = NULL;
+    int n, i, failed = 0, changed = 0;
+
+    /*
+     *  The Video Mode from the Database is the same for all Devices
+     */
 
-	ConvertFromVideoMode(&Current, &var);
+    if (Opt_modename) {
+	if (!modes) {
+	    if (!(Modes = FBSetCreate()))
+		Die("No memory\n");
+	    FBSetVerbose(Modes, Opt_verbose ? out : NULL);
+	    if (FBSetLoadModes(Modes, Opt_modedb ? 1 : 0, &Opt_modedb,
+			       Opt_modecache, Opt_modename,
+			       Opt_strict ? FBSET_LOAD_STRICT : 0))
+		Die("%s\n", FBSetErrorMessage(Modes));
+	    modes = Modes;
+	}
+	if (FBSetFindMode(modes, Opt_modename, &vmode))
+	    Die("%s\n", FBSetErrorMessage(modes));
 	if (Opt_verbose)
-	    printf("Setting video mode to `%s'\n", Opt_fb);
-	SetVarScreenInfo(fh, &var);
-	ConvertToVideoMode(&var, &Current);
+	    fprintf(out, "Using video mode `%s' from `%s'\n", Opt_modename,
+		    vmode.file);
+    }
+
+    heads = FindHeads(Opt_fb, &n);
+
+    /*
+     *  Open the Devices and get their Video Modes
+     */
+
+    for (i = 0; i < n; i++) {
+	head = &heads[i];
+	if (CatchErrors(&trap)) {
+	    strcpy(head->msg, trap.msg);
+	    head->failed = 1;
+	    continue;
+	}
+	head->fs = OpenDevice(head->name, out);
+	if (Opt_modename)
+	    head->vmode = vmode;
+	else if (FBSetGetMode(head->fs, &head->vmode))
+	    Die("%s\n", FBSetErrorMessage(head->fs));
+	if (Opt_change && FBSetModifyMode(head->fs, &head->vmode, &Opt_modify))
+	    Die("%s\n", FBSetErrorMessage(head->fs));
+	FBSetVerbose(head->fs, NULL);
+	PopErrorTrap(&trap);
+    }
+
+    /*
+     *  Set the Video Modes, all at once
+     */
+
+    if (Opt_change && Opt_transaction && !Opt_test) {
+	for (i = 0; i < n; i++) {
+	    head = &heads[i];
+	    if (!head->failed && FBSetGetVar(head->fs, &head->saved)) {
+		snprintf(head->msg, sizeof(head->msg), "%s",
+			 FBSetErrorMessage(head->fs));
+		head->failed = 1;
+	    }
+	}
+	if (RunThreads(heads, n, TestHeadMode))
+	    outcome = "nothing was set";
+	else if (RunThreads(heads, n, SetHeadMode)) {
+	    RunThreads(heads, n, RestoreHeadMode);
+	    outcome = "the others were restored";
+	}
+    } else if (Opt_change)
+	RunThreads(heads, n, SetHeadMode);
+
+    if (Opt_change) {
+	fprintf(out, "%-16s %-10s %10s  %s\n", "Device", "Status",
+		"Time (us)", "Mode");
+	for (i = 0; i < n; i++) {
+	    head = &heads[i];
+	    status = head->restored > 0 ? "restored" :
+		     head->restored < 0 ? "unrestored" :
+		     head->failed ? "failed" :
+		     outcome ? "not set" :
+		     Opt_test ? "valid" :
+		     head->changed ? "set" : "unchanged";
+	    if (head->failed || head->restored < 0)
+		fprintf(out, "%-16s %-10s %10ld  %s\n", head->name, status,
+			head->usecs, head->msg);
+	    else
+		fprintf(out, "%-16s %-10s %10ld  %ux%u, %u bpp\n", head->name,
+			status, head->usecs, head->vmode.xres,
+			head->vmode.yres, head->vmode.depth);
+	}
     }
 
     /*
      *  Display some Video Mode Information
      */
 
-    if (Opt_show || !Opt_change)
-	DisplayVModeInfo(&Current);
+    for (i = 0; i < n; i++) {
+	head = &heads[i];
+	if (!head->failed && (Opt_show || !Opt_change)) {
+	    fprintf(out, "\n# %s\n", head->name);
+	    DisplayVModeInfo(out, &head->vmode);
+	}
+	if (!head->failed && Opt_info) {
+	    if (FBSetGetFix(head->fs, &fix)) {
+		snprintf(head->msg, sizeof(head->msg), "%s",
+			 FBSetErrorMessage(head->fs));
+		head->failed = 1;
+	    } else
+		DisplayFBInfo(out, &fix);
+	}
+	if (head->failed && !Opt_change)
+	    fprintf(out, "\n# %s: %s\n", head->name, head->msg);
+	failed += head->failed || head->restored < 0;
+	changed |= head->changed;
+	free((char *)head->name);
+    }
+    free(heads);
+
+    if (outcome)
+	Die("%d of %d frame buffer devices failed, %s\n", failed, n, outcome);
+    if (failed)
+	Die("%d of %d frame buffer devices failed\n", failed, n);
+    return Opt_status && !changed ? 2 : 0;
+}
+
+
+    /*
+     *  Try every Video Mode of the Database on the Device
+     *
+     *  Each mode goes to the driver with FB_ACTIVATE_TEST, unless the probe
+     *  cache knows the answer, so nothing changes. One line per mode, with
+     *  tab separated columns: the name, whether the driver accepted,
+     *  adjusted or rejected it, the video mode it would really set, the
+     *  refresh rate of that, and the fields it adjusted or why it rejected
+     *  the mode.
+     */
+
+struct Probe {
+    struct FBSet *fs;
+    FILE *out;
+    u_int accepted, adjusted, rejected;
+};
 
-    if (Opt_info) {
-	if (Opt_verbose)
-	    puts("Getting further frame buffer information");
-	GetFixScreenInfo(fh, &fix);
-	DisplayFBInfo(&fix);
+static int ProbeMode(const struct VideoMode *vmode, void *arg)
+{
+    struct Probe *probe = arg;
+    struct fb_var_screeninfo var, wanted;
+    const char *fields[FBSET_VAR_FIELDS];
+    struct VideoMode real;
+    int n, i;
+
+    FBSetConvertFromVideoMode(vmode, &var);
+    var.activate = FB_ACTIVATE_TEST;
+    wanted = var;
+    if (FBSetTestVar(probe->fs, &var)) {
+	fprintf(probe->out, "%s\trejected\t-\t-\t-\t-\t-\t-\t-\t%s\n",
+		vmode->name, FBSetErrorMessage(probe->fs));
+	probe->rejected++;
+	return 0;
+    }
+    FBSetConvertToVideoMode(&var, &real);
+    FBSetFillScanRates(&real);
+    n = FBSetCompareVar(&var, &wanted, FBSET_COMPARE_EXACT, fields);
+    fprintf(probe->out, "%s\t%s\t%u\t%u\t%u\t%u\t%u\t%u\t%.3f\t",
+	    vmode->name, n ? "adjusted" : "accepted", real.xres, real.yres,
+	    real.vxres, real.vyres, real.depth, real.pixclock, real.vrate);
+    for (i = 0; i < n; i++)
+	fprintf(probe->out, "%s%s", i ? "," : "", fields[i]);
+    fputs(n ? "\n" : "-\n", probe->out);
+    if (n)
+	probe->adjusted++;
+    else
+	probe->accepted++;
+    return 0;
+}
+
+
+static int ProbeModes(struct FBSet *modes, struct FBSet *fs, FILE *out)
+{
+    struct Probe probe;
+    struct timespec t0, t1;
+    double secs;
+    u_int n;
+
+    if (!modes) {
+	modes = fs;
+	if (FBSetLoadModes(fs, Opt_modedb ? 1 : 0, &Opt_modedb, Opt_modecache,
+			   NULL, Opt_strict ? FBSET_LOAD_STRICT : 0))
+	    Die("%s\n", FBSetErrorMessage(fs));
     }
 
+    memset(&probe, 0, sizeof(probe));
+    probe.fs = fs;
+    probe.out = out;
+    fputs("# name\tresult\txres\tyres\tvxres\tvyres\tdepth\tpixclock\t"
+	  "vrate\tdetails\n", out);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    FBSetForEachMode(modes, ProbeMode, &probe);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    n = probe.accepted+probe.adjusted+probe.rejected;
+    secs = (t1.tv_sec-t0.tv_sec)+(t1.tv_nsec-t0.tv_nsec)/1E9;
+    fprintf(out, "# %u modes: %u accepted, %u adjusted, %u rejected, "
+		 "%.0f probes/s\n", n, probe.accepted, probe.adjusted,
+	    probe.rejected, secs > 0 ? n/secs : 0);
+    return 0;
+}
+
+
+    /*
+     *  Time the Ioctls of the Device
+     *
+     *  Each ioctl is called n times in a row through the library, which
+     *  only returns an error code, so nothing unwinds out of the loop; the
+     *  first failure ends the ioctl's run. FBIOPUT_VSCREENINFO gets the
+     *  current video mode with FB_ACTIVATE_TEST and FBIOPAN_DISPLAY the
+     *  current offsets, so the display does not change. Then a histogram
+     *  of each, by powers of two.
+     */
+
+#define BENCH_GETVAR	0
+#define BENCH_GETFIX	1
+#define BENCH_TESTVAR	2
+#define BENCH_PAN	3
+#define BENCH_IOCTLS	4
+
+#define BENCH_BAR	40		/* width of the longest bar */
+
+static const char *const BenchNames[BENCH_IOCTLS] = {
+    "FBIOGET_VSCREENINFO", "FBIOGET_FSCREENINFO", "FBIOPUT_VSCREENINFO",
+    "FBIOPAN_DISPLAY"
+};
+
+static int CompareNsecs(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static int Log2(unsigned long long x)
+{
+    int i;
+
+    for (i = 0; x > 1; i++)
+	x >>= 1;
+    return i;
+}
+
+
+static void BenchHistogram(FILE *out, const char *name,
+			   const unsigned long long *nsecs, u_long n)
+{
+    u_long buckets[64], most = 0, i;
+    int lo, hi, b, len;
+
+    memset(buckets, 0, sizeof(buckets));
+    for (i = 0; i < n; i++)
+	buckets[Log2(nsecs[i])]++;
+    lo = Log2(nsecs[0]);
+    hi = Log2(nsecs[n-1]);
+    for (b = lo; b <= hi; b++)
+	if (buckets[b] > most)
+	    most = buckets[b];
+
+    fprintf(out, "\n%s\n", name);
+    for (b = lo; b <= hi; b++) {
+	fprintf(out, "  %10llu - %10llu ns %10lu", 1ULL << b, (2ULL << b)-1,
+		buckets[b]);
+	if ((len = (buckets[b]*BENCH_BAR+most-1)/most))
+	    fputs("  ", out);
+	while (len-- > 0)
+	    fputc('#', out);
+	fputc('\n', out);
+    }
+}
+
+
+static u_long BenchCount(const char *arg)
+{
+    u_long n;
+    char *end;
+
+    n = strtoul(arg, &end, 10);
+    if (!n || *end || n > (size_t)-1/sizeof(unsigned long long))
+	Die("Bad number of calls `%s'\n", arg);
+    return n;
+}
+
+
+    /*
+     *  Sort the Times of n Calls, and print the Shortest, Median, 99th
+     *  Percentile and Longest
+     */
+
+static void BenchRow(FILE *out, unsigned long long *nsecs, u_long n)
+{
+    qsort(nsecs, n, sizeof(*nsecs), CompareNsecs);
+    fprintf(out, " %10llu %10llu %10llu %10llu\n", nsecs[0],
+	    nsecs[(n-1)/2], nsecs[(n*99+99)/100-1], nsecs[n-1]);
+}
+
+
+static int BenchIoctls(struct FBSet *fs, FILE *out)
+{
+    struct fb_var_screeninfo cur, var;
+    struct fb_fix_screeninfo fix;
+    unsigned long long *nsecs[BENCH_IOCTLS], start;
+    char errors[BENCH_IOCTLS][MAX_MESSAGE];
+    u_long done[BENCH_IOCTLS], n, i;
+    int k, nbench, res = 0;
+
+    n = BenchCount(Opt_bench);
+    if (FBSetGetVar(fs, &cur))
+	Die("%s\n", FBSetErrorMessage(fs));
+    nbench = Opt_benchpan ? BENCH_IOCTLS : BENCH_PAN;
+    for (k = 0; k < nbench; k++)
+	if (!(nsecs[k] = malloc(n*sizeof(**nsecs)))) {
+	    while (k--)
+		free(nsecs[k]);
+	    Die("No memory\n");
+	}
+
+    for (k = 0; k < nbench; k++) {
+	errors[k][0] = '\0';
+	for (i = 0; i < n; i++) {
+	    var = cur;
+	    var.activate = k == BENCH_TESTVAR ? FB_ACTIVATE_TEST :
+						 FB_ACTIVATE_NOW;
+	    start = Nsecs();
+	    switch (k) {
+		case BENCH_GETVAR:
+		    res = FBSetGetVar(fs, &var);
+		    break;
+		case BENCH_GETFIX:
+		    res = FBSetGetFix(fs, &fix);
+		    break;
+		case BENCH_TESTVAR:
+		    res = FBSetPutVar(fs, &var);
+		    break;
+		case BENCH_PAN:
+		    res = FBSetPanDisplay(fs, &var);
+		    break;
+	    }
+	    nsecs[k][i] = Nsecs()-start;
+	    if (res) {
+		snprintf(errors[k], sizeof(errors[k]), "%s",
+			 FBSetErrorMessage(fs));
+		break;
+	    }
+	}
+	done[k] = i;
+    }
+
+    fprintf(out, "%-20s %10s %10s %10s %10s %10s\n", "Ioctl", "Calls",
+	    "Min (ns)", "Median", "p99", "Max");
+    for (k = 0; k < nbench; k++) {
+	if (!done[k]) {
+	    fprintf(out, "%-20s %10s  %s\n", BenchNames[k], "failed",
+		    errors[k]);
+	    continue;
+	}
+	fprintf(out, "%-20s %10lu", BenchNames[k], done[k]);
+	BenchRow(out, nsecs[k], done[k]);
+	if (errors[k][0])
+	    fprintf(out, "%-20s %10s  %s\n", "", "then", errors[k]);
+    }
+    for (k = 0; k < nbench; k++)
+	if (done[k])
+	    BenchHistogram(out, BenchNames[k], nsecs[k], done[k]);
+
+    for (k = 0; k < nbench; k++)
+	free(nsecs[k]);
+    for (k = 0; k < nbench; k++)
+	if (errors[k][0])
+	    Die("%s failed\n", BenchNames[k]);
+    return 0;
+}
+
+
+    /*
+     *  Time Page Flips
+     *
+     *  The virtual resolution gets room for a second buffer below the
+     *  visible one, starting at a multiple of the pan step, and the display
+     *  flips n times between the two with FBIOPAN_DISPLAY: by panning, and
+     *  by wrapping too if the device can. The video mode is restored after.
+     */
+
+static int BenchFlips(struct FBSet *fs, FILE *out)
+{
+    static const char *const names[2] = { "ypan", "ywrap" };
+    struct fb_var_screeninfo saved, var;
+    struct fb_fix_screeninfo fix;
+    unsigned long long *nsecs[2], start, total;
+    __u32 step, offset;
+    u_long n, i, done[2] = { 0, 0 };
+    int wrap, res = 0;
+
+    n = BenchCount(Opt_benchflip);
+    if (FBSetGetVar(fs, &saved) || FBSetGetFix(fs, &fix))
+	Die("%s\n", FBSetErrorMessage(fs));
+    if (!fix.ypanstep && !fix.ywrapstep)
+	Die("%s cannot pan\n", Opt_fb);
+    step = fix.ypanstep ? fix.ypanstep : fix.ywrapstep;
+    offset = (saved.yres+step-1)/step*step;
+    if (!fix.line_length ||
+	(unsigned long long)fix.line_length*(offset+saved.yres) >
+	fix.smem_len)
+	Die("Not enough video memory for two buffers of %ux%u\n", saved.xres,
+	    saved.yres);
+    if (!(nsecs[0] = malloc(2*n*sizeof(**nsecs))))
+	Die("No memory\n");
+    nsecs[1] = nsecs[0]+n;
+
+    var = saved;
+    var.yres_virtual = offset+saved.yres;
+    var.xoffset = var.yoffset = 0;
+    var.activate = FB_ACTIVATE_NOW;
+    if (FBSetPutVar(fs, &var)) {
+	free(nsecs[0]);
+	Die("%s\n", FBSetErrorMessage(fs));
+    }
+    if (Opt_verbose)
+	fprintf(out, "Flipping between buffers %u lines apart\n", offset);
+
+    fprintf(out, "%-20s %10s %10s %10s %10s %10s %10s\n", "Flip", "Flips",
+	    "Flips/s", "Min (ns)", "Median", "p99", "Max");
+    for (wrap = 0; wrap < 2 && !res; wrap++) {
+	if ((wrap ? !fix.ywrapstep || offset % fix.ywrapstep :
+		    !fix.ypanstep))
+	    continue;
+	var.vmode = (var.vmode & ~FB_VMODE_YWRAP) |
+		    (wrap ? FB_VMODE_YWRAP : 0);
+	total = Nsecs();
+	for (i = 0; i < n; i++) {
+	    var.yoffset = i & 1 ? 0 : offset;
+	    start = Nsecs();
+	    res = FBSetPanDisplay(fs, &var);
+	    nsecs[wrap][i] = Nsecs()-start;
+	    if (res)
+		break;
+	}
+	total = Nsecs()-total;
+	if (!(done[wrap] = i)) {
+	    fprintf(out, "%-20s %10s  %s\n", names[wrap], "failed",
+		    FBSetErrorMessage(fs));
+	    continue;
+	}
+	fprintf(out, "%-20s %10lu %10.0f", names[wrap], i, i*1E9/total);
+	BenchRow(out, nsecs[wrap], i);
+	if (res)
+	    fprintf(out, "%-20s %10s  %s\n", "", "then",
+		    FBSetErrorMessage(fs));
+    }
+    for (wrap = 0; wrap < 2; wrap++)
+	if (done[wrap])
+	    BenchHistogram(out, names[wrap], nsecs[wrap], done[wrap]);
+    free(nsecs[0]);
+
+    saved.activate = FB_ACTIVATE_NOW;
+    if (FBSetPutVar(fs, &saved))
+	Die("%s\n", FBSetErrorMessage(fs));
+    if (res)
+	Die("Flipping failed\n");
+    return 0;
+}
+
+
+    /*
+     *  Time the Frame Buffer Memory
+     *
+     *  The memory is mapped and taken as lines of line_length bytes, each
+     *  trimmed to whole blocks of MEM_BLOCK bytes, so all kernels see the
+     *  same aligned memory. Every kernel writes, reads, and copies the upper
+     *  half of the lines to the lower half, for MEM_BENCH_NSECS each: with
+     *  one thread, and with n threads that take every n-th line. What was in
+     *  the memory is put back after.
+     */
+
+#define MEM_WRITE		0
+#define MEM_READ		1
+#define MEM_COPY		2
+#define MEM_OPS			3
+
+#define MEM_BENCH_NSECS		250000000ULL
+#define MEM_PATTERN		0x0123456789abcdefULL
+#define MAX_MEM_THREADS		256
+
+struct MemStripe {
+    const struct MemKernel *kernel;
+    int op;
+    char *mem;
+    size_t line_length;
+    u_long lines;			/* all of them */
+    u_long first, step;			/* those of the thread */
+    pthread_t thread;
+    unsigned long long bytes;
+    __u64 sum;				/* of reads, so they are done */
+};
+
+static unsigned long long MemStart;
+
+
+    /*
+     *  A Line trimmed to whole Blocks
+     */
+
+static char *MemLine(const struct MemStripe *ms, u_long y, size_t *len)
+{
+    uintptr_t start = (uintptr_t)ms->mem+y*ms->line_length;
+    uintptr_t end = (start+ms->line_length) & ~(uintptr_t)(MEM_BLOCK-1);
+
+    start = (start+MEM_BLOCK-1) & ~(uintptr_t)(MEM_BLOCK-1);
+    *len = end > start ? end-start : 0;
+    return (char *)start;
+}
+
+
+static void *MemStripeThread(void *arg)
+{
+    struct MemStripe *ms = arg;
+    const struct MemKernel *k = ms->kernel;
+    unsigned long long deadline;
+    u_long y, lines = ms->op == MEM_COPY ? ms->lines/2 : ms->lines;
+    size_t len, len2;
+    char *line, *line2;
+
+    pthread_mutex_lock(&GateLock);
+    while (GateClosed)
+	pthread_cond_wait(&GateOpen, &GateLock);
+    pthread_mutex_unlock(&GateLock);
+
+    deadline = MemStart+MEM_BENCH_NSECS;
+    do {
+	for (y = ms->first; y < lines; y += ms->step) {
+	    line = MemLine(ms, y, &len);
+	    switch (ms->op) {
+		case MEM_WRITE:
+		    k->write(line, len, MEM_PATTERN);
+		    break;
+		case MEM_READ:
+		    ms->sum ^= k->read(line, len);
+		    break;
+		case MEM_COPY:
+		    line2 = MemLine(ms, y+lines, &len2);
+		    if (len2 < len)
+			len = len2;
+		    k->copy(line2, line, len);
+		    break;
+	    }
+	    ms->bytes += len;
+	}
+    } while (Nsecs() < deadline);
+    return NULL;
+}
+
+
+    /*
+     *  Run an Operation of a Kernel in n Threads
+     *
+     *  Returns the bytes per second, or -1 if a thread could not be created.
+     */
+
+static double MemStripes(struct MemStripe *stripes, u_long n,
+			 const struct MemKernel *kernel, int op)
+{
+    unsigned long long bytes = 0;
+    u_long i, started;
+    int failed = 0;
+
+    GateClosed = 1;
+    for (started = 0; started < n; started++) {
+	stripes[started].kernel = kernel;
+	stripes[started].op = op;
+	stripes[started].first = started;
+	stripes[started].step = n;
+	stripes[started].bytes = 0;
+	if (pthread_create(&stripes[started].thread, NULL, MemStripeThread,
+			   &stripes[started])) {
+	    failed = 1;
+	    break;
+	}
+    }
+    pthread_mutex_lock(&GateLock);
+    MemStart = Nsecs();
+    GateClosed = 0;
+    pthread_cond_broadcast(&GateOpen);
+    pthread_mutex_unlock(&GateLock);
+
+    for (i = 0; i < started; i++) {
+	pthread_join(stripes[i].thread, NULL);
+	bytes += stripes[i].bytes;
+    }
+    return failed ? -1 : bytes*1E9/(Nsecs()-MemStart);
+}
+
+
+static int BenchMemory(struct FBSet *fs, FILE *out)
+{
+    struct fb_fix_screeninfo fix;
+    struct MemStripe *stripes;
+    const struct MemKernel *k;
+    void *mem;
+    char *saved, *end;
+    size_t len;
+    u_long n, threads[2], i;
+    double rate;
+    int op, t, failed = 0;
+
+    n = strtoul(Opt_benchmem, &end, 10);
+    if (!n || *end || n > MAX_MEM_THREADS)
+	Die("Bad number of threads `%s'\n", Opt_benchmem);
+    if (FBSetGetFix(fs, &fix) || FBSetMapMemory(fs, 1, &mem, &len))
+	Die("%s\n", FBSetErrorMessage(fs));
+    if (!(stripes = calloc(n, sizeof(*stripes))) ||
+	!(saved = malloc(len))) {
+	free(stripes);
+	Die("No memory\n");
+    }
+    /* also brings in every page, before anything is timed */
+    memcpy(saved, mem, len);
+
+    stripes[0].mem = mem;
+    stripes[0].line_length = fix.line_length && fix.line_length <= len ?
+			     fix.line_length : 4096;
+    stripes[0].lines = len/stripes[0].line_length;
+    for (i = 1; i < n; i++)
+	stripes[i] = stripes[0];
+    if (Opt_verbose)
+	fprintf(out, "Mapped %zu bytes, as %lu lines of %zu bytes\n", len,
+		stripes[0].lines, stripes[0].line_length);
+
+    threads[0] = 1;
+    threads[1] = n;
+    fprintf(out, "%-20s %10s %12s %12s %12s\n", "Kernel", "Threads",
+	    "Write MB/s", "Read MB/s", "Copy MB/s");
+    for (k = MemKernels; k->name && !failed; k++) {
+	if (k->usable && !k->usable())
+	    continue;
+	for (t = 0; t < (n > 1 ? 2 : 1) && !failed; t++) {
+	    fprintf(out, "%-20s %10lu", k->name, threads[t]);
+	    for (op = 0; op < MEM_OPS; op++) {
+		if (op == MEM_READ && !k->read) {
+		    fprintf(out, " %12s", "-");
+		    continue;
+		}
+		if ((rate = MemStripes(stripes, threads[t], k, op)) < 0) {
+		    failed = 1;
+		    break;
+		}
+		fprintf(out, " %12.1f", rate/1E6);
+	    }
+	    fputc('\n', out);
+	}
+    }
+
+    memcpy(mem, saved, len);
+    free(saved);
+    free(stripes);
+    if (failed)
+	Die("Cannot create a thread\n");
+    return 0;
+}
+
+
+    /*
+     *  Map the Visible Screen
+     *
+     *  Its pixels must be packed true color ones that PixelFormatInit()
+     *  understands, and every line of the virtual screen must lie within
+     *  the frame buffer memory. It is only mapped for writing if writable
+     *  is set. what is the option, for the messages.
+     */
+
+#define BAND_ROWS		32	/* rows per band of a thread, at least */
+#define MAX_BAND_THREADS	64
+
+static void *MapScreen(struct FBSet *fs, struct fb_var_screeninfo *var,
+		       struct fb_fix_screeninfo *fix, struct PixelFormat *pf,
+		       int writable, const char *what)
+{
+    void *mem;
+    size_t len;
+
+    if (FBSetGetVar(fs, var) || FBSetGetFix(fs, fix))
+	Die("%s\n", FBSetErrorMessage(fs));
+    if (fix->type != FB_TYPE_PACKED_PIXELS ||
+	fix->visual != FB_VISUAL_TRUECOLOR || PixelFormatInit(pf, var))
+	Die("%s needs packed true color pixels of 8, 16, 24 or 32 bits\n",
+	    what);
+    if (!var->xres || !var->yres || var->yoffset >= var->yres_virtual ||
+	(unsigned long long)fix->line_length*(var->yres_virtual-1)+
+	(unsigned long long)(var->xoffset+var->xres)*pf->bytes >
+	fix->smem_len)
+	Die("The screen lies outside the frame buffer memory\n");
+    if (FBSetMapMemory(fs, writable, &mem, &len))
+	Die("%s\n", FBSetErrorMessage(fs));
+    return mem;
+}
+
+
+    /*
+     *  Start of Row y of the Visible Screen
+     *
+     *  Wrapping may have moved the top of the screen down.
+     */
+
+static char *ScreenRow(char *mem, const struct fb_var_screeninfo *var,
+		       const struct fb_fix_screeninfo *fix,
+		       const struct PixelFormat *pf, u_int y)
+{
+    return mem+(size_t)((var->yoffset+y) % var->yres_virtual)*
+	       fix->line_length+var->xoffset*pf->bytes;
+}
+
+
+    /*
+     *  Number of Threads for Bands of rows Rows
+     */
+
+static u_int CountThreads(u_int rows)
+{
+    u_int n = (rows+BAND_ROWS-1)/BAND_ROWS;
+    long ncpus;
+
+    if ((ncpus = sysconf(_SC_NPROCESSORS_ONLN)) > 0 && ncpus < n)
+	n = ncpus;
+    if (n > MAX_BAND_THREADS)
+	n = MAX_BAND_THREADS;
+    return n;
+}
+
+
+    /*
+     *  Dump the Screen to an Image File
+     *
+     *  The visible screen is converted to RGB in bands of rows, on large
+     *  screens by a thread each, and a round of bands is written out before
+     *  the next one is converted, so the image is never held in memory as a
+     *  whole.
+     */
+
+struct DumpBand {
+    const struct PixelFormat *pf;
+    const struct fb_var_screeninfo *var;
+    const struct fb_fix_screeninfo *fix;
+    char *mem;
+    u_int y, rows;			/* of the screen */
+    __u8 *rgb;
+    size_t stride;			/* of the rows in rgb */
+    pthread_t thread;
+    int started;
+};
+
+
+static void *ConvertBand(void *arg)
+{
+    struct DumpBand *band = arg;
+    u_int i;
+
+    for (i = 0; i < band->rows; i++)
+	PixelsToRGB(band->pf, band->rgb+i*band->stride,
+		    ScreenRow(band->mem, band->var, band->fix, band->pf,
+			      band->y+i), band->var->xres);
+    return NULL;
+}
+
+
+static int DumpScreen(struct FBSet *fs, FILE *out)
+{
+    struct fb_var_screeninfo var;
+    struct fb_fix_screeninfo fix;
+    struct PixelFormat pf;
+    struct DumpBand bands[MAX_BAND_THREADS], *band;
+    struct Image img;
+    unsigned long long start;
+    const char *ext;
+    char *mem;
+    __u8 *rgb;
+    size_t stride;
+    u_int y, i, nbands, nthreads;
+    int png;
+
+    if (!(ext = strrchr(Opt_dump, '.')) ||
+	(strcasecmp(ext, ".ppm") && strcasecmp(ext, ".png")))
+	Die("Unknown image format of `%s', use .ppm or .png\n", Opt_dump);
+    png = !strcasecmp(ext, ".png");
+    mem = MapScreen(fs, &var, &fix, &pf, 0, "--dump");
+
+    nthreads = CountThreads(var.yres);
+    stride = 3*var.xres+PIXEL_SLACK;
+    if (!(rgb = malloc(nthreads*BAND_ROWS*stride)))
+	Die("No memory\n");
+    if (ImageOpen(&img, Opt_dump, png, var.xres, var.yres)) {
+	free(rgb);
+	Die("%s: %s\n", Opt_dump, strerror(errno));
+    }
+
+    start = Nsecs();
+    for (y = 0; y < var.yres; y += nbands*BAND_ROWS) {
+	for (nbands = 0;
+	     nbands < nthreads && y+nbands*BAND_ROWS < var.yres; nbands++) {
+	    band = &bands[nbands];
+	    band->pf = &pf;
+	    band->var = &var;
+	    band->fix = &fix;
+	    band->mem = mem;
+	    band->y = y+nbands*BAND_ROWS;
+	    band->rows = var.yres-band->y < BAND_ROWS ? var.yres-band->y
+						       : BAND_ROWS;
+	    band->rgb = rgb+nbands*BAND_ROWS*stride;
+	    band->stride = stride;
+	}
+	for (i = 0; i < nbands; i++) {
+	    band = &bands[i];
+	    /* without a thread, the band is converted right here */
+	    band->started = nbands > 1 &&
+			    !pthread_create(&band->thread, NULL, ConvertBand,
+					    band);
+	    if (!band->started)
+		ConvertBand(band);
+	}
+	for (i = 0; i < nbands; i++)
+	    if (bands[i].started)
+		pthread_join(bands[i].thread, NULL);
+	for (i = 0; y+i < var.yres && i < nbands*BAND_ROWS; i++)
+	    ImageWriteRow(&img, rgb+i*stride);
+    }
+    free(rgb);
+    if (ImageClose(&img))
+	Die("%s: %s\n", Opt_dump, strerror(errno));
+    if (Opt_verbose)
+	fprintf(out, "Dumped %ux%u at %u bpp to `%s' in %.3f ms, with %u "
+		"thread%s\n", var.xres, var.yres, var.bits_per_pixel, Opt_dump,
+		(Nsecs()-start)/1E6, nthreads, nthreads == 1 ? "" : "s");
+    return 0;
+}
+
+
+    /*
+     *  Draw a Test Pattern
+     *
+     *  Every pattern is made of a few kinds of rows, which are drawn once in
+     *  the pixel format of the screen, and then stored into the frame buffer
+     *  row after row, by a thread for every band of rows on large screens.
+     *
+     *	bars	eight vertical color bars: white, yellow, cyan, green,
+     *		magenta, red, blue and black
+     *	grid	white lines on black every 32 pixels, and along the edges
+     *	ramp	four horizontal stripes going from black to white, red,
+     *		green and blue
+     *	solid	white
+     */
+
+#define PATTERN_BARS		0
+#define PATTERN_GRID		1
+#define PATTERN_RAMP		2
+#define PATTERN_SOLID		3
+
+#define PATTERN_ROWS		4	/* kinds of rows, at most */
+#define GRID_STEP		32
+
+static const char *const PatternNames[] = {
+    "bars", "grid", "ramp", "solid", NULL
+};
+
+struct PatternBand {
+    const struct fb_var_screeninfo *var;
+    const struct fb_fix_screeninfo *fix;
+    const struct PixelFormat *pf;
+    char *mem;
+    int pattern;
+    const __u8 *rows[PATTERN_ROWS];	/* in the pixel format */
+    u_int y, nrows;			/* of the screen */
+    pthread_t thread;
+    int started;
+};
+
+
+    /*
+     *  Kind of Row y
+     */
+
+static u_int PatternRow(int pattern, u_int y, u_int yres)
+{
+    switch (pattern) {
+	case PATTERN_GRID:
+	    return !(y % GRID_STEP) || y == yres-1;
+	case PATTERN_RAMP:
+	    return (unsigned long long)y*4/yres;
+    }
+    return 0;
+}
+
+
+    /*
+     *  Draw Row kind in RGB
+     */
+
+static void PatternRGB(int pattern, u_int kind, __u8 *rgb, u_int xres)
+{
+    static const __u8 bars[8][3] = {
+	{ 255, 255, 255 }, { 255, 255, 0 }, { 0, 255, 255 }, { 0, 255, 0 },
+	{ 255, 0, 255 }, { 255, 0, 0 }, { 0, 0, 255 }, { 0, 0, 0 }
+    };
+    u_int x, c, v;
+
+    for (x = 0; x < xres; x++, rgb += 3)
+	switch (pattern) {
+	    case PATTERN_BARS:
+		memcpy(rgb, bars[(unsigned long long)x*8/xres], 3);
+		break;
+	    case PATTERN_GRID:
+		memset(rgb, kind || !(x % GRID_STEP) || x == xres-1 ? 255 : 0,
+		       3);
+		break;
+	    case PATTERN_RAMP:
+		v = xres > 1 ? x*255ULL/(xres-1) : 0;
+		for (c = 0; c < 3; c++)
+		    rgb[c] = !kind || kind == c+1 ? v : 0;
+		break;
+	    case PATTERN_SOLID:
+		memset(rgb, 255, 3);
+		break;
+	}
+}
+
+
+static void *FillBand(void *arg)
+{
+    struct PatternBand *band = arg;
+    const struct fb_var_screeninfo *var = band->var;
+    size_t len = (size_t)var->xres*band->pf->bytes;
+    u_int y;
+
+    for (y = band->y; y < band->y+band->nrows; y++)
+	StorePixels(ScreenRow(band->mem, var, band->fix, band->pf, y),
+		    band->rows[PatternRow(band->pattern, y, var->yres)], len);
+    return NULL;
+}
+
+
+static int DrawPattern(struct FBSet *fs, FILE *out)
+{
+    struct fb_var_screeninfo var;
+    struct fb_fix_screeninfo fix;
+    struct PixelFormat pf;
+    struct PatternBand bands[MAX_BAND_THREADS], *band;
+    unsigned long long nsecs;
+    char *mem;
+    __u8 *rgb, *rows;
+    size_t len;
+    u_int i, per, nbands, nthreads;
+    int pattern;
+
+    for (pattern = 0; PatternNames[pattern]; pattern++)
+	if (!strcmp(Opt_pattern, PatternNames[pattern]))
+	    break;
+    if (!PatternNames[pattern])
+	Die("Unknown pattern `%s', use bars, grid, ramp or solid\n",
+	    Opt_pattern);
+    mem = MapScreen(fs, &var, &fix, &pf, 1, "--pattern");
+
+    len = (size_t)var.xres*pf.bytes;
+    if (!(rgb = malloc(3*var.xres)) ||
+	!(rows = malloc(PATTERN_ROWS*len))) {
+	free(rgb);
+	Die("No memory\n");
+    }
+    for (i = 0; i < PATTERN_ROWS; i++) {
+	PatternRGB(pattern, i, rgb, var.xres);
+	RGBToPixels(&pf, rows+i*len, rgb, var.xres);
+    }
+    free(rgb);
+
+    nthreads = CountThreads(var.yres);
+    per = (var.yres+nthreads-1)/nthreads;
+    for (nbands = 0; nbands*per < var.yres; nbands++) {
+	band = &bands[nbands];
+	band->var = &var;
+	band->fix = &fix;
+	band->pf = &pf;
+	band->mem = mem;
+	band->pattern = pattern;
+	for (i = 0; i < PATTERN_ROWS; i++)
+	    band->rows[i] = rows+i*len;
+	band->y = nbands*per;
+	band->nrows = var.yres-band->y < per ? var.yres-band->y : per;
+    }
+
+    nsecs = Nsecs();
+    for (i = 0; i < nbands; i++) {
+	band = &bands[i];
+	/* without a thread, the band is filled right here */
+	band->started = nbands > 1 &&
+			!pthread_create(&band->thread, NULL, FillBand, band);
+	if (!band->started)
+	    FillBand(band);
+    }
+    for (i = 0; i < nbands; i++)
+	if (bands[i].started)
+	    pthread_join(bands[i].thread, NULL);
+    nsecs = Nsecs()-nsecs;
+    free(rows);
+
+    fprintf(out, "Filled %ux%u at %u bpp with %s in %.3f ms (%.1f MB/s), "
+	    "with %u thread%s\n", var.xres, var.yres, var.bits_per_pixel,
+	    PatternNames[pattern], nsecs/1E6,
+	    nsecs ? len*var.yres*1E3/nsecs : 0.0, nbands,
+	    nbands == 1 ? "" : "s");
+    return 0;
+}
+
+
+    /*
+     *  Run a Command
+     *
+     *  Video modes are looked up in modes, or in a database read into the
+     *  device's handle if modes is NULL. Returns the exit status.
+     */
+
+static int RunCommand(struct FBSet *modes, FILE *out)
+{
+    struct fb_fix_screeninfo fix;
+    struct Device *dev;
+    struct FBSet *fs;
+    int changed = 0;
+
+    if (Opt_stats) {
+	StatsStart = Nsecs();
+	DisplayNsecs = 0;
+	if (Modes)
+	    FBSetClearStats(Modes);
+	for (dev = Devices; dev; dev = dev->next)
+	    FBSetClearStats(dev->fs);
+    }
+
+    if (Opt_version || Opt_verbose)
+	fputs(VERSION "\n", out);
+
+    if (!Opt_fb)
+	Opt_fb = DEFAULT_FRAMEBUFFER;
+    if (strpbrk(Opt_fb, ",*?[") || Opt_transaction) {
+	if (Opt_probe || Opt_bench || Opt_benchflip || Opt_benchmem ||
+	    Opt_dump || Opt_pattern)
+	    Die("%s takes one frame buffer device\n",
+		Opt_probe ? "--probe-all" :
+		Opt_bench ? "--bench-ioctl" :
+		Opt_benchflip ? "--bench-flip" :
+		Opt_benchmem ? "--bench-mem" :
+		Opt_dump ? "--dump" : "--pattern");
+	return RunHeads(modes, out);
+    }
+
+    /*
+     *  Open the Frame Buffer Device
+     */
+
+    fs = OpenDevice(Opt_fb, out);
+
+    if (Opt_probe)
+	return ProbeModes(modes, fs, out);
+    if (Opt_bench)
+	return BenchIoctls(fs, out);
+    if (Opt_benchflip)
+	return BenchFlips(fs, out);
+    if (Opt_benchmem)
+	return BenchMemory(fs, out);
+
+    /*
+     *  Get the Video Mode
+     */
+
+    if (Opt_modename) {
+
+	/*
+	 *  Read the Video Mode Database
+	 */
+
+	if (!modes) {
+	    modes = fs;
+	    if (FBSetLoadModes(fs, Opt_modedb ? 1 : 0, &Opt_modedb,
+			       Opt_modecache, Opt_modename,
+			       Opt_strict ? FBSET_LOAD_STRICT : 0))
+		Die("%s\n", FBSetErrorMessage(fs));
+	}
+	if (FBSetFindMode(modes, Opt_modename, &Current))
+	    Die("%s\n", FBSetErrorMessage(modes));
+
+	if (Opt_verbose)
+	    fprintf(out, "Using video mode `%s' from `%s'\n", Opt_modename,
+		    Current.file);
+    } else {
+	if (FBSetGetMode(fs, &Current))
+	    Die("%s\n", FBSetErrorMessage(fs));
+	if (Opt_verbose)
+	    fprintf(out, "Using current video mode from `%s'\n", Opt_fb);
+    }
+
+    if (Opt_change) {
+
+	/*
+	 *  Optionally Modify the Video Mode
+	 */
+
+	if (FBSetModifyMode(fs, &Current, &Opt_modify))
+	    Die("%s\n", FBSetErrorMessage(fs));
+
+	/*
+	 *  Set the Video Mode, unless it is active already
+	 */
+
+	if (SetMode(fs, &Current, &changed))
+	    Die("%s\n", FBSetErrorMessage(fs));
+    }
+
+    /*
+     *  Display some Video Mode Information
+     */
+
+    if (Opt_show || (!Opt_change && !Opt_dump && !Opt_pattern))
+	DisplayVModeInfo(out, &Current);
+
+    if (Opt_info) {
+	if (Opt_verbose)
+	    fputs("Getting further frame buffer information\n", out);
+	if (FBSetGetFix(fs, &fix))
+	    Die("%s\n", FBSetErrorMessage(fs));
+	DisplayFBInfo(out, &fix);
+    }
+
+    /*
+     *  Draw a Test Pattern, and Dump the Screen
+     */
+
+    if (Opt_pattern)
+	DrawPattern(fs, out);
+    if (Opt_dump)
+	DumpScreen(fs, out);
+
+    return Opt_status && !changed ? 2 : 0;
+}
+
+
+    /*
+     *  Print the Statistics of the Command
+     *
+     *  One line of key=value pairs, summed over all handles, so it is easy
+     *  to collect: times in nanoseconds and the number of calls of each
+     *  step, then the size of the video mode database.
+     */
+
+static void AddStats(struct FBSetStats *sum, const struct FBSet *fs)
+{
+    struct FBSetStats stats;
+    int i;
+
+    FBSetGetStats(fs, &stats);
+    for (i = 0; i < FBSET_STATS; i++) {
+	sum->calls[i] += stats.calls[i];
+	sum->nsecs[i] += stats.nsecs[i];
+    }
+    sum->nmodes += stats.nmodes;
+    sum->parsed += stats.parsed;
+    sum->allocs += stats.allocs;
+    sum->memory += stats.memory;
+    sum->compiled |= stats.compiled;
+}
+
+
+static void PrintStats(FILE *f)
+{
+    static const char *const steps[FBSET_STATS] = {
+	"modedb", "open", "getvar", "putvar", "getfix", "pan"
+    };
+    struct FBSetStats sum;
+    struct Device *dev;
+    int i;
+
+    memset(&sum, 0, sizeof(sum));
+    if (Modes)
+	AddStats(&sum, Modes);
+    for (dev = Devices; dev; dev = dev->next)
+	AddStats(&sum, dev->fs);
+
+    fprintf(f, "stats: total_ns=%llu", Nsecs()-StatsStart);
+    for (i = 0; i < FBSET_STATS; i++)
+	fprintf(f, " %s_ns=%llu %s_calls=%u", steps[i], sum.nsecs[i], steps[i],
+		sum.calls[i]);
+    fprintf(f, " display_ns=%llu modes=%u parsed_bytes=%lu allocs=%u "
+	       "memory_bytes=%lu compiled=%d\n", DisplayNsecs, sum.nmodes,
+	    (u_long)sum.parsed, sum.allocs, (u_long)sum.memory, sum.compiled);
+}
+
+
+    /*
+     *  Load the Video Mode Database of the Daemon or a Batch
+     *
+     *  On failure the old database stays in use.
+     */
+
+int LoadModes(FILE *verbose)
+{
+    struct FBSet *fs;
+
+    if (!(fs = FBSetCreate())) {
+	fputs("No memory\n", stderr);
+	return -1;
+    }
+    FBSetVerbose(fs, verbose);
+    if (FBSetLoadModes(fs, Opt_modedb ? 1 : 0, &Opt_modedb, Opt_modecache,
+		       NULL, Opt_strict ? FBSET_LOAD_STRICT : 0)) {
+	fprintf(stderr, "%s\n", FBSetErrorMessage(fs));
+	FBSetDestroy(fs);
+	return -1;
+    }
+    FBSetVerbose(fs, NULL);
+    if (Modes)
+	FBSetDestroy(Modes);
+    Modes = fs;
+    return 0;
+}
+
+
+    /*
+     *  Run a Request of the Daemon or a Line of a Batch
+     *
+     *  argv[0] is skipped. Returns the exit status fbset would have, and
+     *  what it would print goes to out. If it fails, msg (of MAX_MESSAGE
+     *  bytes) gets the error message.
+     */
+
+int RunRequest(int argc, char *argv[], FILE *out, char *msg)
+{
+    struct ErrorTrap trap;
+    struct Device *dev;
+    const char *bad;
+    int status = 0;
+
+    ResetOptions();
+    if (CatchErrors(&trap)) {
+	strcpy(msg, trap.msg);
+	status = 1;
+    } else {
+	if ((bad = ParseOptions(argc, argv, 1)))
+	    Die("Invalid option `%s'\n", bad);
+	status = RunCommand(Modes, out);
+	PopErrorTrap(&trap);
+	/* a request has no stderr of its own */
+	if (Opt_stats)
+	    PrintStats(out == stdout ? stderr : out);
+    }
+    for (dev = Devices; dev; dev = dev->next)
+	FBSetVerbose(dev->fs, NULL);
+    return status;
+}
+
+
+    /*
+     *  Run the Commands in a File, one per Line
+     *
+     *  The lines are split like requests of the daemon; empty lines and
+     *  lines starting with `#' are skipped. A failing command does not stop
+     *  the others, but makes the exit status 1.
+     */
+
+static int RunBatch(const char *file)
+{
+    char *argv[MAX_REQUEST_ARGS+2];
+    char msg[MAX_MESSAGE];
+    char *line = NULL, *s;
+    const char *name = file;
+    size_t size = 0;
+    int argc, lineno = 0, status = 0;
+    FILE *f;
+
+    if (!strcmp(file, "-")) {
+	f = stdin;
+	name = "stdin";
+    } else if (!(f = fopen(file, "r")))
+	Die("open %s: %s\n", file, strerror(errno));
+
+    while (getline(&line, &size, f) != -1) {
+	lineno++;
+	if ((s = strchr(line, '\n')))
+	    *s = '\0';
+	for (s = line; *s == ' ' || *s == '\t'; s++);
+	if (!*s || *s == '#')
+	    continue;
+	argv[0] = (char *)ProgramName;
+	if ((argc = SplitRequest(s, argv+1)) < 0)
+	    strcpy(msg, "Syntax error");
+	else if (RunRequest(argc+1, argv, stdout, msg) != 1) {
+	    fflush(stdout);
+	    continue;
+	}
+	fflush(stdout);
+	fprintf(stderr, "%s:%d: %s\n", name, lineno, msg);
+	status = 1;
+    }
+    if (ferror(f))
+	Die("read %s: %s\n", file, strerror(errno));
+    if (f != stdin)
+	fclose(f);
+    free(line);
+    return status;
+}
+
+
+    /*
+     *  Name the Compiled Database of a Database given with -db
+     *
+     *  Every database gets a compiled database of its own, so fbset calls
+     *  with different databases do not keep replacing each other's. The
+     *  name comes from an FNV-1a hash of the absolute path; a clash only
+     *  costs a parse, as the compiled database records the paths it was
+     *  built from.
+     */
+
+static const char *ModeCacheName(const char *modedb)
+{
+    static char name[sizeof(DB_MODECACHE)+8];
+    const char *s;
+    char *path;
+    __u32 hash = 2166136261U;
+
+    path = realpath(modedb, NULL);
+    for (s = path ? path : modedb; *s; s++)
+	hash = (hash ^ (unsigned char)*s)*16777619U;
+    free(path);
+    sprintf(name, DB_MODECACHE, hash);
+    return name;
+}
+
+
+    /*
+     *  Main Routine
+     */
+
+int main(int argc, char *argv[])
+{
+    int i, j;
+
+    ProgramName = argv[0];
+
+    if (ParseOptions(argc, argv, 0))
+	Usage();
+    if (Opt_modedb && Opt_modecache == DefaultModeCache)
+	Opt_modecache = ModeCacheName(Opt_modedb);
+
+    /*
+     *  Hand the Command to the Daemon
+     */
+
+    if (Opt_client) {
+	for (i = j = 1; i < argc; i++)
+	    if (!strcmp(argv[i], "--socket"))
+		i++;
+	    else if (strcmp(argv[i], "--client"))
+		argv[j++] = argv[i];
+	exit(SendRequest(Opt_socket, j, argv));
+    }
+
+    /*
+     *  Become the Daemon
+     */
+
+    if (Opt_daemon) {
+	if (Opt_modename || Opt_change)
+	    Usage();
+	if (Opt_version || Opt_verbose)
+	    puts(VERSION);
+	if (LoadModes(Opt_verbose ? stdout : NULL))
+	    exit(1);
+	ServeRequests(Opt_socket, Opt_verbose);
+	CloseDevices();
+	exit(0);
+    }
+
+    /*
+     *  Run a Batch of Commands
+     */
+
+    if (Opt_batch) {
+	if (Opt_modename || Opt_change)
+	    Usage();
+	if (Opt_version || Opt_verbose)
+	    puts(VERSION);
+	if (LoadModes(Opt_verbose ? stdout : NULL))
+	    exit(1);
+	i = RunBatch(Opt_batch);
+	CloseDevices();
+	exit(i);
+    }
+
+    i = RunCommand(NULL, stdout);
+    if (Opt_stats)
+	PrintStats(stderr);
+
     /*
      *  Close the Frame Buffer Device
      */
 
-    CloseFrameBuffer(fh);
+    CloseDevices();
 
-    exit(0);
+    exit(i);
 }
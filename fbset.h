@@ -13,70 +13,301 @@
 
 
 #include <stdio.h>
+#include <setjmp.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
-#ifdef __GLIBC__
-#include <asm/types.h>
-#endif
+#include "libfbset.h"
 
 #define VERSION         "Linux Frame Buffer Device Configuration " \
 			"Version 2.1 (23/06/1999)\n"  \
 			"(C) Copyright 1995-1999 by Geert Uytterhoeven\n"
 
-#define LOW		(0)
-#define HIGH		(1)
+#define LOW		FBSET_LOW
+#define HIGH		FBSET_HIGH
 
 #define FALSE		(0)
 #define TRUE		(1)
 
-struct color {
-    unsigned int length;
-    unsigned int offset;
+
+    /*
+     *  Default Frame Buffer Special Device Node
+     */
+
+#define DEFAULT_FRAMEBUFFER	"/dev/fb0"
+
+
+    /*
+     *  Default Video Mode Database File
+     */
+
+#define DEFAULT_MODEDBFILE	"/etc/fb.modes"
+
+
+    /*
+     *  Default Video Mode Database Directory (*.modes, read after the file)
+     */
+
+#define DEFAULT_MODEDBDIR	"/etc/fb.modes.d"
+
+
+    /*
+     *  Longest Error Message, with the NUL
+     */
+
+#define MAX_MESSAGE		512
+
+
+struct ModeArena {
+    struct ModeArenaChunk *chunks;
+    char *next;
+    char *end;
+    size_t used;
+    size_t reserved;
+    u_int nchunks;
 };
 
-struct VideoMode {
-    struct VideoMode *next;
-    const char *name;
-    /* geometry */
-    __u32 xres;
-    __u32 yres;
-    __u32 vxres;
-    __u32 vyres;
-    __u32 depth;
-    __u32 nonstd;
-    /* acceleration */
-    __u32 accel_flags;
-    /* timings */
-    __u32 pixclock;
-    __u32 left;
-    __u32 right;
-    __u32 upper;
-    __u32 lower;
-    __u32 hslen;
-    __u32 vslen;
-    /* flags */
-    unsigned hsync : 1;
-    unsigned vsync : 1;
-    unsigned csync : 1;
-    unsigned gsync : 1;
-    unsigned extsync : 1;
-    unsigned bcast : 1;
-    unsigned laced : 1;
-    unsigned dblscan : 1;
-    unsigned grayscale : 1;
-    /* scanrates */
-    double drate;
-    double hrate;
-    double vrate;
-    /* RGB entries */
-    struct color red, green, blue, transp;
+struct ModeSource {
+    struct ModeSource *next;
+    const char *path;
+    int root;				/* given to LoadModeDB() */
+    struct stat st;			/* all zero if missing */
 };
 
-extern FILE *yyin;
-extern int line;
-extern const char *Opt_modedb;
+struct ModeDB {
+    struct VideoMode *modes;		/* in file order */
+    struct VideoMode **tail;
+    u_int nmodes;
+    struct VideoMode **index;		/* by name */
+    u_int indexsize;
+    const char **strindex;		/* interned strings */
+    u_int strindexsize;
+    u_int nstrings;
+    struct ModeArena records;
+    struct ModeArena strings;
+    struct ModeDBMapping *mappings;	/* scanned database files */
+    struct ModeSource *sources;		/* everything that was read */
+    struct ModeSource **sourcetail;
+    size_t parsed;			/* bytes of database files read */
+    u_int allocs;			/* blocks allocated outside the arenas */
+    char error[MAX_MESSAGE];		/* of the last call that failed */
+};
+
+struct ModeParser {
+    struct ModeDB *db;			/* database being filled */
+    const char *file;			/* for diagnostics */
+    int line;
+    int depth;				/* include nesting */
+    int error;				/* FBSET_ERR_*, message in db */
+    struct VideoMode vmode;		/* mode being parsed */
+};
+
+struct ModeCache {
+    const char *base;			/* mapped image, NULL if none */
+    size_t size;
+    const struct ModeCacheEntry *entries;
+    const __u32 *index;
+    const char *strings;
+    __u32 nmodes, hashsize, strsize;
+};
+
+struct ProbeCache {
+    char *file;				/* NULL if not in use */
+    struct fb_fix_screeninfo fix;	/* identity of the device */
+    struct ProbeCacheEntry *entries;
+    __u32 nentries, size;
+    __u32 *index;			/* entry number + 1, 0 = free */
+    int dirty;				/* file needs to be written */
+};
+
+extern int yyparse(struct ModeParser *mp, void *scanner);
+extern void yyerror(struct ModeParser *mp, void *scanner, const char *s);
+extern int FindToken(struct ModeParser *mp, const char *s, int len,
+		     long *value);
+extern int ParseModeBuffer(struct ModeParser *mp, char *buf, size_t len);
+extern int ScanModeBuffer(struct ModeParser *mp, char *buf, size_t len,
+			  int (*fn)(int token, long value, void *arg),
+			  void *arg);
+extern int AddVideoMode(struct ModeParser *mp);
+extern int makeRGBA(struct VideoMode *vmode, const char* opt);
 
-extern int yyparse(void);
+    /*
+     *  Error Handling of the fbset Command (fbset.c)
+     *
+     *  Die() unwinds to the innermost trap set by the calling thread, which
+     *  then holds the message, or prints the message and exits if there is
+     *  none. The trap is gone once Die() returns to it; otherwise it must be
+     *  removed with PopErrorTrap(). The library never calls Die(): its
+     *  functions return FBSET_ERR_* codes instead.
+     */
+
+struct ErrorTrap {
+    jmp_buf env;
+    struct ErrorTrap *prev;
+    char msg[MAX_MESSAGE];		/* without trailing newline */
+};
+
+#define CatchErrors(trap)	(PushErrorTrap(trap), setjmp((trap)->env))
+
+extern void PushErrorTrap(struct ErrorTrap *trap);
+extern void PopErrorTrap(struct ErrorTrap *trap);
 extern void Die(const char *fmt, ...) __attribute__ ((noreturn));
-extern void AddVideoMode(const struct VideoMode *vmode);
-extern void makeRGBA(struct VideoMode *vmode, const char* opt);
+
+    /*
+     *  Video Mode Database Storage (modedb.c)
+     */
+
+extern __u32 HashString(const char *s, size_t len);
+extern __u32 HashModeName(const char *name);
+extern int ModeDBFail(struct ModeDB *db, int error, const char *fmt, ...);
+extern struct ModeDB *ModeDBCreate(void);
+extern void ModeDBFree(struct ModeDB *db);
+extern char *ModeDBMapFile(struct ModeDB *db, int fd, size_t size);
+extern const char *ModeDBString(struct ModeDB *db, const char *s, size_t len);
+extern struct VideoMode *ModeDBAdd(struct ModeDB *db,
+				   const struct VideoMode *vmode);
+extern struct VideoMode *ModeDBFind(const struct ModeDB *db, const char *name);
+extern int ModeDBMerge(struct ModeDB *db, struct ModeDB *from);
+extern int ModeDBAddSource(struct ModeDB *db, const char *path,
+			   const struct stat *st, int root);
+extern size_t ModeDBMemory(const struct ModeDB *db);
+extern u_int ModeDBAllocs(const struct ModeDB *db);
+
+extern int IncludeModeFile(struct ModeParser *mp, const char *name);
+extern int ParseModeFile(struct ModeDB *db, const char *file);
+extern int ParseModeFiles(struct ModeDB *db, int n, const char *const files[]);
+extern int LoadModeDB(struct ModeDB *db, int n, const char *const paths[],
+		      int optional);
+extern int LookupModeDB(struct ModeDB *db, int n, const char *const paths[],
+			int optional, const char *name);
+
+    /*
+     *  Compiled Video Mode Database (modecache.c)
+     */
+
+extern int ModeCacheOpen(struct ModeCache *mc, const char *cachefile, int n,
+			 const char *const paths[]);
+extern void ModeCacheClose(struct ModeCache *mc);
+extern int ModeCacheWritable(const char *cachefile);
+extern int ModeCacheLookup(const struct ModeCache *mc, const char *name,
+			   struct VideoMode *vmode);
+extern int ModeCacheGet(const struct ModeCache *mc, u_int i,
+			struct VideoMode *vmode);
+extern int ModeCacheWrite(const char *cachefile, const struct ModeDB *db);
+
+    /*
+     *  Frame Buffer Device Backends (device.c, fakefb.c)
+     *
+     *  A backend opens devices by name, carries out their ioctls and maps
+     *  their frame buffer memory, for reading only or for writing too. These
+     *  return 0 or an errno value.
+     */
+
+struct DeviceBackend {
+    const char *name;
+    int (*open)(const char *name, void **dev);
+    void (*close)(void *dev);
+    int (*ioctl)(void *dev, int request, void *arg);
+    int (*map)(void *dev, size_t len, int writable, void **mem);
+    void (*unmap)(void *dev, void *mem, size_t len);
+};
+
+extern const struct DeviceBackend KernelBackend;
+extern const struct DeviceBackend FakeBackend;
+extern const struct DeviceBackend *FindBackend(const char *name);
+
+    /*
+     *  Cached Probe Results (probecache.c)
+     */
+
+extern int ProbeCacheOpen(struct ProbeCache *pc, const char *dir,
+			  const struct fb_fix_screeninfo *fix);
+extern int ProbeCacheLookup(const struct ProbeCache *pc,
+			    const struct fb_var_screeninfo *var,
+			    struct fb_var_screeninfo *result);
+extern void ProbeCacheAdd(struct ProbeCache *pc,
+			  const struct fb_var_screeninfo *var,
+			  const struct fb_var_screeninfo *result, int error);
+extern int ProbeCacheClose(struct ProbeCache *pc);
+
+    /*
+     *  The Daemon and Batches (fbset.c, server.c)
+     */
+
+#define MAX_REQUEST_ARGS	64	/* arguments in a request, with the id */
+
+extern int LoadModes(FILE *verbose);
+extern int RunRequest(int argc, char *argv[], FILE *out, char *msg);
+extern void CloseDevices(void);
+extern int SplitRequest(char *s, char *argv[]);
+extern void ServeRequests(const char *path, int verbose);
+extern int SendRequest(const char *path, int argc, char *argv[]);
+
+    /*
+     *  Frame Buffer Memory Kernels (fbmem.c)
+     */
+
+#define MEM_BLOCK		64	/* alignment and unit of the kernels */
+
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2			/* built for it, whatever CC targets */
+#define TARGET_AVX2	__attribute__ ((target("avx2")))
+extern int HaveAVX2(void);		/* the processor can run it */
+#endif
+
+struct MemKernel {
+    const char *name;
+    void (*write)(void *dst, size_t len, __u64 pattern);
+    __u64 (*read)(const void *src, size_t len);	/* NULL if it cannot */
+    void (*copy)(void *dst, const void *src, size_t len);
+    int (*usable)(void);		/* by this processor, NULL if always */
+};
+
+extern const struct MemKernel MemKernels[];	/* up to a NULL name */
+
+    /*
+     *  Pixel Formats (pixel.c)
+     */
+
+#define PIXEL_SLACK		16	/* written beyond converted pixels */
+
+struct PixelFormat {
+    u_int bytes;			/* per pixel */
+    u_int offset[3], length[3];		/* of red, green, blue */
+    __u32 opaque;			/* the transparency bits, all set */
+    u_int shift[3];			/* of the top bits of red, green, blue */
+    u_int bits[3];			/* at most 8 */
+    /* converts as many pixels as it can, with SSE2 or AVX2, or NULL */
+    u_int (*vector)(const struct PixelFormat *pf, __u8 *rgb, const __u8 *src,
+		    u_int n);
+    __u8 widen[3][256];			/* to 8 bits */
+};
+
+extern int PixelFormatInit(struct PixelFormat *pf,
+			   const struct fb_var_screeninfo *var);
+extern void PixelsToRGB(const struct PixelFormat *pf, __u8 *rgb,
+			const void *src, u_int n);
+extern __u32 PixelFromRGB(const struct PixelFormat *pf, const __u8 rgb[3]);
+extern void RGBToPixels(const struct PixelFormat *pf, void *dst,
+			const __u8 *rgb, u_int n);
+extern void StorePixels(void *dst, const void *src, size_t len);
+
+    /*
+     *  Image Files (image.c)
+     */
+
+struct Image {
+    FILE *f;
+    int png;
+    u_int width;
+    __u8 *block;			/* PNG: the deflate block being filled */
+    size_t used;
+    u_long blocks;			/* written so far */
+    __u32 adler_a, adler_b;
+    __u32 crc[256];
+};
+
+extern int ImageOpen(struct Image *img, const char *file, int png,
+		     u_int width, u_int height);
+extern void ImageWriteRow(struct Image *img, const __u8 *rgb);
+extern int ImageClose(struct Image *img);
@@ -0,0 +1,209 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Image Files
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Writes 8 bit RGB images row by row, as binary PPM or as PNG, so a whole
+ *  image never has to be in memory. Without zlib, PNG image data is kept
+ *  in stored (uncompressed) deflate blocks, each in an IDAT chunk of its
+ *  own.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fbset.h"
+
+
+#define STORED_MAX	65535		/* bytes in a stored deflate block */
+#define ADLER_BASE	65521
+#define ADLER_NMAX	5552		/* bytes before the sums can overflow */
+
+static const __u8 PngSignature[8] = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+};
+
+
+static void PutBE32(__u8 *p, __u32 v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+
+static __u32 Crc32(const struct Image *img, __u32 crc, const __u8 *p,
+		   size_t len)
+{
+    while (len--)
+	crc = img->crc[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+
+static void WriteChunk(struct Image *img, const char *type, const __u8 *data,
+		       __u32 len)
+{
+    __u8 buf[8];
+    __u32 crc;
+
+    PutBE32(buf, len);
+    memcpy(buf+4, type, 4);
+    crc = Crc32(img, 0xffffffff, buf+4, 4);
+    crc = Crc32(img, crc, data, len) ^ 0xffffffff;
+    fwrite(buf, 8, 1, img->f);
+    if (len)
+	fwrite(data, len, 1, img->f);
+    PutBE32(buf, crc);
+    fwrite(buf, 4, 1, img->f);
+}
+
+
+    /*
+     *  Write the Stored Block being filled as an IDAT Chunk
+     *
+     *  The buffer holds the zlib header, the block header and the data. The
+     *  first chunk starts with the zlib header, and the last one, with the
+     *  final block, ends with the Adler-32 of all data.
+     */
+
+static void FlushBlock(struct Image *img, int final)
+{
+    __u8 *p = img->block;
+    size_t start = img->blocks ? 2 : 0, len = img->used;
+
+    p[2] = final;
+    p[3] = len;
+    p[4] = len >> 8;
+    p[5] = ~len;
+    p[6] = ~len >> 8;
+    len += 7;
+    if (final) {
+	PutBE32(p+len, img->adler_b << 16 | img->adler_a);
+	len += 4;
+    }
+    WriteChunk(img, "IDAT", p+start, len-start);
+    img->blocks++;
+    img->used = 0;
+}
+
+
+static void Deflate(struct Image *img, const __u8 *data, size_t len)
+{
+    size_t n, i;
+
+    while (len) {
+	n = STORED_MAX-img->used;
+	if (n > len)
+	    n = len;
+	if (n > ADLER_NMAX)
+	    n = ADLER_NMAX;
+	memcpy(img->block+7+img->used, data, n);
+	for (i = 0; i < n; i++) {
+	    img->adler_a += data[i];
+	    img->adler_b += img->adler_a;
+	}
+	img->adler_a %= ADLER_BASE;
+	img->adler_b %= ADLER_BASE;
+	img->used += n;
+	data += n;
+	len -= n;
+	if (img->used == STORED_MAX)
+	    FlushBlock(img, 0);
+    }
+}
+
+
+    /*
+     *  Start an Image of width x height Pixels
+     *
+     *  Returns -1, with errno set, if the file cannot be created.
+     */
+
+int ImageOpen(struct Image *img, const char *file, int png, u_int width,
+	      u_int height)
+{
+    __u8 ihdr[13];
+    __u32 c;
+    int i;
+
+    memset(img, 0, sizeof(*img));
+    img->png = png;
+    img->width = width;
+    if (png) {
+	if (!(img->block = malloc(7+STORED_MAX+4)))
+	    return -1;
+	for (c = 0; c < 256; c++) {
+	    img->crc[c] = c;
+	    for (i = 0; i < 8; i++)
+		img->crc[c] = img->crc[c] & 1 ? 0xedb88320 ^ img->crc[c] >> 1
+					      : img->crc[c] >> 1;
+	}
+	img->adler_a = 1;
+	/* deflate, 32k window, no dictionary, fastest */
+	img->block[0] = 0x78;
+	img->block[1] = 0x01;
+    }
+    if (!(img->f = fopen(file, "wb"))) {
+	free(img->block);
+	return -1;
+    }
+
+    if (png) {
+	fwrite(PngSignature, sizeof(PngSignature), 1, img->f);
+	PutBE32(ihdr, width);
+	PutBE32(ihdr+4, height);
+	ihdr[8] = 8;			/* bits per channel */
+	ihdr[9] = 2;			/* RGB */
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	WriteChunk(img, "IHDR", ihdr, sizeof(ihdr));
+    } else
+	fprintf(img->f, "P6\n%u %u\n255\n", width, height);
+    return 0;
+}
+
+
+    /*
+     *  Add a Row of 3*width Bytes
+     */
+
+void ImageWriteRow(struct Image *img, const __u8 *rgb)
+{
+    static const __u8 filter = 0;	/* none */
+
+    if (img->png) {
+	Deflate(img, &filter, 1);
+	Deflate(img, rgb, 3*img->width);
+    } else
+	fwrite(rgb, 3, img->width, img->f);
+}
+
+
+    /*
+     *  Finish the Image
+     *
+     *  Returns -1, with errno set, if anything could not be written.
+     */
+
+int ImageClose(struct Image *img)
+{
+    int res;
+
+    if (img->png) {
+	FlushBlock(img, 1);
+	WriteChunk(img, "IEND", NULL, 0);
+	free(img->block);
+    }
+    res = ferror(img->f);
+    if (fclose(img->f) || res)
+	return -1;
+    return 0;
+}
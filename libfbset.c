@@ -0,0 +1,1127 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Frame Buffer Configuration Library
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Errors are returned as FBSET_ERR_* codes all the way up: the database
+ *  functions leave their message in the database, and the library calls in
+ *  the handle. Nothing in here prints an error or exits.
+ */
+
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <ctype.h>
+
+#include "fbset.h"
+
+
+struct FBSet {
+    const struct DeviceBackend *backend;
+    void *dev;				/* NULL if no device is open */
+    void *map;				/* NULL if its memory is not mapped */
+    size_t maplen;
+    size_t mapoffset;			/* of the memory in the mapping */
+    int mapwritable;
+    char *device;
+    struct ModeDB *db;
+    struct ModeCache cache;
+    char *probedir;			/* NULL if probes are not cached */
+    struct ProbeCache probes;		/* of the open device */
+    struct FBSetStats stats;		/* only the calls and times */
+    FILE *verbose;
+    char error[MAX_MESSAGE];
+};
+
+
+    /*
+     *  Record the Error of a Call
+     */
+
+static int Fail(struct FBSet *fs, int error, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(fs->error, sizeof(fs->error), fmt, ap);
+    va_end(ap);
+    return error;
+}
+
+
+    /*
+     *  Drop the Database after an Error, keeping its Message
+     */
+
+static int DatabaseFailed(struct FBSet *fs, int error)
+{
+    strcpy(fs->error, fs->db->error);
+    ModeDBFree(fs->db);
+    fs->db = NULL;
+    return error;
+}
+
+
+static void Verbose(struct FBSet *fs, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (!fs->verbose)
+	return;
+    va_start(ap, fmt);
+    vfprintf(fs->verbose, fmt, ap);
+    va_end(ap);
+}
+
+
+    /*
+     *  Time a Call
+     */
+
+static unsigned long long Clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+
+static void Account(struct FBSet *fs, int stat, unsigned long long start)
+{
+    fs->stats.calls[stat]++;
+    fs->stats.nsecs[stat] += Clock()-start;
+}
+
+
+    /*
+     *  Create and Destroy a Handle
+     */
+
+struct FBSet *FBSetCreate(void)
+{
+    struct FBSet *fs;
+
+    if (!(fs = calloc(1, sizeof(*fs))))
+	return NULL;
+    return fs;
+}
+
+
+void FBSetDestroy(struct FBSet *fs)
+{
+    if (!fs)
+	return;
+    FBSetCloseDevice(fs);
+    ModeDBFree(fs->db);
+    ModeCacheClose(&fs->cache);
+    free(fs->probedir);
+    free(fs);
+}
+
+
+    /*
+     *  Report Progress to out (NULL to stop)
+     */
+
+void FBSetVerbose(struct FBSet *fs, FILE *out)
+{
+    fs->verbose = out;
+}
+
+
+const char *FBSetErrorMessage(const struct FBSet *fs)
+{
+    return fs->error;
+}
+
+
+    /*
+     *  Get and Clear the Statistics
+     */
+
+void FBSetGetStats(const struct FBSet *fs, struct FBSetStats *stats)
+{
+    *stats = fs->stats;
+    if (fs->cache.base) {
+	stats->nmodes = fs->cache.nmodes;
+	stats->memory = fs->cache.size;
+	stats->compiled = 1;
+    } else if (fs->db) {
+	stats->nmodes = fs->db->nmodes;
+	stats->parsed = fs->db->parsed;
+	stats->allocs = ModeDBAllocs(fs->db);
+	stats->memory = ModeDBMemory(fs->db);
+    }
+}
+
+
+void FBSetClearStats(struct FBSet *fs)
+{
+    memset(&fs->stats, 0, sizeof(fs->stats));
+}
+
+
+    /*
+     *  Open the Frame Buffer Device
+     */
+
+int FBSetOpenDevice(struct FBSet *fs, const char *name)
+{
+    const struct DeviceBackend *backend = FindBackend(name);
+    unsigned long long start;
+    char *device;
+    void *dev;
+    int error;
+
+    FBSetCloseDevice(fs);
+    Verbose(fs, "Opening frame buffer device `%s'\n", name);
+
+    if (!(device = strdup(name)))
+	return Fail(fs, FBSET_ERR_NOMEM, "No memory");
+    start = Clock();
+    error = backend->open(name, &dev);
+    Account(fs, FBSET_STAT_OPEN, start);
+    if (error) {
+	free(device);
+	return Fail(fs, FBSET_ERR_DEVICE, "open %s: %s", name,
+		    strerror(error));
+    }
+    fs->backend = backend;
+    fs->dev = dev;
+    fs->device = device;
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Write back the Probe Results of the Device
+     */
+
+static void CloseProbes(struct FBSet *fs)
+{
+    if (fs->probes.file && ProbeCacheClose(&fs->probes))
+	Verbose(fs, "Cannot update the probe cache in `%s'\n", fs->probedir);
+}
+
+
+    /*
+     *  Close the Frame Buffer Device
+     */
+
+void FBSetCloseDevice(struct FBSet *fs)
+{
+    CloseProbes(fs);
+    FBSetUnmapMemory(fs);
+    if (fs->dev) {
+	fs->backend->close(fs->dev);
+	fs->dev = NULL;
+    }
+    free(fs->device);
+    fs->device = NULL;
+}
+
+
+static int DeviceIoctl(struct FBSet *fs, int stat, int request,
+		       const char *name, void *arg)
+{
+    unsigned long long start;
+    int error;
+
+    if (!fs->dev)
+	return Fail(fs, FBSET_ERR_DEVICE, "No frame buffer device open");
+    start = Clock();
+    error = fs->backend->ioctl(fs->dev, request, arg);
+    Account(fs, stat, start);
+    if (error)
+	return Fail(fs, FBSET_ERR_DEVICE, "ioctl %s: %s", name,
+		    strerror(error));
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Get the Variable Part of the Screen Info
+     */
+
+int FBSetGetVar(struct FBSet *fs, struct fb_var_screeninfo *var)
+{
+    return DeviceIoctl(fs, FBSET_STAT_GETVAR, FBIOGET_VSCREENINFO,
+		       "FBIOGET_VSCREENINFO", var);
+}
+
+
+    /*
+     *  Set (and Get) the Variable Part of the Screen Info
+     */
+
+int FBSetPutVar(struct FBSet *fs, struct fb_var_screeninfo *var)
+{
+    return DeviceIoctl(fs, FBSET_STAT_PUTVAR, FBIOPUT_VSCREENINFO,
+		       "FBIOPUT_VSCREENINFO", var);
+}
+
+
+    /*
+     *  Test the Variable Part of the Screen Info
+     *
+     *  Like FBSetPutVar() with FB_ACTIVATE_TEST, but a screen info the device
+     *  was asked about before is answered from the probe cache.
+     */
+
+int FBSetTestVar(struct FBSet *fs, struct fb_var_screeninfo *var)
+{
+    struct fb_fix_screeninfo fix;
+    struct fb_var_screeninfo wanted;
+    unsigned long long start;
+    int error;
+
+    if (!fs->dev)
+	return Fail(fs, FBSET_ERR_DEVICE, "No frame buffer device open");
+    var->activate = FB_ACTIVATE_TEST;
+    if (fs->probedir && !fs->probes.file) {
+	start = Clock();
+	error = fs->backend->ioctl(fs->dev, FBIOGET_FSCREENINFO, &fix);
+	Account(fs, FBSET_STAT_GETFIX, start);
+	if (!error)
+	    ProbeCacheOpen(&fs->probes, fs->probedir, &fix);
+    }
+
+    if (!fs->probes.file)
+	return FBSetPutVar(fs, var);
+    if ((error = ProbeCacheLookup(&fs->probes, var, var)) == -1) {
+	wanted = *var;
+	start = Clock();
+	error = fs->backend->ioctl(fs->dev, FBIOPUT_VSCREENINFO, var);
+	Account(fs, FBSET_STAT_PUTVAR, start);
+	/* only a rejection of the mode itself is for good */
+	if (!error || error == EINVAL)
+	    ProbeCacheAdd(&fs->probes, &wanted, error ? NULL : var, error);
+    }
+    if (error)
+	return Fail(fs, FBSET_ERR_DEVICE, "ioctl FBIOPUT_VSCREENINFO: %s",
+		    strerror(error));
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Cache Probe Results in dir (NULL to stop)
+     *
+     *  There is a file per driver and memory size, which is read when the
+     *  first video mode is tested, and written back when the device is
+     *  closed.
+     */
+
+int FBSetProbeCache(struct FBSet *fs, const char *dir)
+{
+    char *copy = NULL;
+
+    if (dir && fs->probedir && !strcmp(dir, fs->probedir))
+	return FBSET_OK;
+    if (dir && !(copy = strdup(dir)))
+	return Fail(fs, FBSET_ERR_NOMEM, "No memory");
+    CloseProbes(fs);
+    free(fs->probedir);
+    fs->probedir = copy;
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Get the Fixed Part of the Screen Info
+     */
+
+int FBSetGetFix(struct FBSet *fs, struct fb_fix_screeninfo *fix)
+{
+    return DeviceIoctl(fs, FBSET_STAT_GETFIX, FBIOGET_FSCREENINFO,
+		       "FBIOGET_FSCREENINFO", fix);
+}
+
+
+    /*
+     *  Pan the Display to the Offsets in var
+     */
+
+int FBSetPanDisplay(struct FBSet *fs, struct fb_var_screeninfo *var)
+{
+    return DeviceIoctl(fs, FBSET_STAT_PAN, FBIOPAN_DISPLAY, "FBIOPAN_DISPLAY",
+		       var);
+}
+
+
+    /*
+     *  Map the Frame Buffer Memory
+     *
+     *  mem receives its start and len its size (smem_len). Unless writable
+     *  is set, the memory is only mapped for reading. The mapping is shared
+     *  by further calls, and lasts until FBSetUnmapMemory() or the device is
+     *  closed, except that a mapping for reading only is replaced when the
+     *  memory is first wanted writable.
+     */
+
+int FBSetMapMemory(struct FBSet *fs, int writable, void **mem, size_t *len)
+{
+    struct fb_fix_screeninfo fix;
+    size_t page, offset, maplen;
+    void *map;
+    int error, res;
+
+    if ((res = FBSetGetFix(fs, &fix)))
+	return res;
+    if (writable && !fs->mapwritable)
+	FBSetUnmapMemory(fs);
+    if (!fs->map) {
+	/* the memory need not start on a page */
+	page = sysconf(_SC_PAGESIZE);
+	offset = (unsigned long)fix.smem_start & (page-1);
+	maplen = (offset+fix.smem_len+page-1) & ~(page-1);
+	if ((error = fs->backend->map(fs->dev, maplen, writable, &map)))
+	    return Fail(fs, FBSET_ERR_DEVICE, "mmap %s: %s", fs->device,
+			strerror(error));
+	fs->map = map;
+	fs->maplen = maplen;
+	fs->mapoffset = offset;
+	fs->mapwritable = writable;
+    }
+    *mem = (char *)fs->map+fs->mapoffset;
+    *len = fix.smem_len;
+    return FBSET_OK;
+}
+
+
+void FBSetUnmapMemory(struct FBSet *fs)
+{
+    if (fs->map) {
+	fs->backend->unmap(fs->dev, fs->map, fs->maplen);
+	fs->map = NULL;
+    }
+}
+
+
+    /*
+     *  Get the Current Video Mode
+     */
+
+int FBSetGetMode(struct FBSet *fs, struct VideoMode *vmode)
+{
+    struct fb_var_screeninfo var;
+    int res;
+
+    if ((res = FBSetGetVar(fs, &var)))
+	return res;
+    FBSetConvertToVideoMode(&var, vmode);
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Set a Video Mode
+     *
+     *  activate is one of FB_ACTIVATE_NOW, FB_ACTIVATE_TEST or
+     *  FB_ACTIVATE_ALL. vmode receives the video mode the device settled on.
+     */
+
+int FBSetApplyMode(struct FBSet *fs, struct VideoMode *vmode, __u32 activate)
+{
+    struct fb_var_screeninfo var;
+    int res;
+
+    FBSetConvertFromVideoMode(vmode, &var);
+    var.activate = activate;
+    Verbose(fs, "Setting video mode to `%s'\n", fs->device);
+    if (activate == FB_ACTIVATE_TEST)
+	res = FBSetTestVar(fs, &var);
+    else
+	res = FBSetPutVar(fs, &var);
+    if (res)
+	return res;
+    FBSetConvertToVideoMode(&var, vmode);
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Fields of the Screen Info that make up a Video Mode
+     *
+     *  Drivers round the pixel clock to what their clock generator can do,
+     *  so clocks within 0.5% are the same. A color of length 0 is left to the
+     *  driver, so only requested colors count, and of vmode only the basic
+     *  bits do.
+     */
+
+#define VAR_EXACT	0
+#define VAR_CLOCK	1
+#define VAR_VMODE	2
+#define VAR_COLOR	3
+
+#define VAR(field)	offsetof(struct fb_var_screeninfo, field)
+
+static const struct VarField {
+    const char *name;
+    size_t offset;
+    int kind;
+} VarFields[] = {
+    { "xres", VAR(xres), VAR_EXACT },
+    { "yres", VAR(yres), VAR_EXACT },
+    { "vxres", VAR(xres_virtual), VAR_EXACT },
+    { "vyres", VAR(yres_virtual), VAR_EXACT },
+    { "depth", VAR(bits_per_pixel), VAR_EXACT },
+    { "grayscale", VAR(grayscale), VAR_EXACT },
+    { "nonstd", VAR(nonstd), VAR_EXACT },
+    { "accel", VAR(accel_flags), VAR_EXACT },
+    { "pixclock", VAR(pixclock), VAR_CLOCK },
+    { "left", VAR(left_margin), VAR_EXACT },
+    { "right", VAR(right_margin), VAR_EXACT },
+    { "upper", VAR(upper_margin), VAR_EXACT },
+    { "lower", VAR(lower_margin), VAR_EXACT },
+    { "hslen", VAR(hsync_len), VAR_EXACT },
+    { "vslen", VAR(vsync_len), VAR_EXACT },
+    { "sync", VAR(sync), VAR_EXACT },
+    { "vmode", VAR(vmode), VAR_VMODE },
+    { "red", VAR(red), VAR_COLOR },
+    { "green", VAR(green), VAR_COLOR },
+    { "blue", VAR(blue), VAR_COLOR },
+    { "transp", VAR(transp), VAR_COLOR },
+};
+
+
+    /*
+     *  Compare the active Screen Info with the wanted one
+     *
+     *  Returns the number of fields that differ. Their names go to fields,
+     *  if not NULL, and they are listed when fs is verbose.
+     */
+
+static int CompareVar(struct FBSet *fs, const struct fb_var_screeninfo *cur,
+		      const struct fb_var_screeninfo *var, int flags,
+		      const char *fields[])
+{
+    const struct VarField *f;
+    const struct fb_bitfield *cb, *vb;
+    __u32 c, v;
+    int i, n = 0;
+
+    for (i = 0; i < sizeof(VarFields)/sizeof(*VarFields); i++) {
+	f = &VarFields[i];
+	if (f->kind == VAR_COLOR) {
+	    cb = (const struct fb_bitfield *)((const char *)cur+f->offset);
+	    vb = (const struct fb_bitfield *)((const char *)var+f->offset);
+	    if (!vb->length ||
+		(cb->length == vb->length && cb->offset == vb->offset))
+		continue;
+	    if (fs)
+		Verbose(fs, "    %-9s %u/%u -> %u/%u\n", f->name, cb->length,
+			cb->offset, vb->length, vb->offset);
+	    if (fields)
+		fields[n] = f->name;
+	    n++;
+	    continue;
+	}
+	c = *(const __u32 *)((const char *)cur+f->offset);
+	v = *(const __u32 *)((const char *)var+f->offset);
+	if (f->kind == VAR_CLOCK && !(flags & FBSET_COMPARE_EXACT)) {
+	    if ((c > v ? c-v : v-c) <= v/200)
+		continue;
+	} else if (f->kind == VAR_VMODE) {
+	    c &= FB_VMODE_MASK;
+	    v &= FB_VMODE_MASK;
+	}
+	if (c == v)
+	    continue;
+	if (fs)
+	    Verbose(fs, "    %-9s %u -> %u\n", f->name, c, v);
+	if (fields)
+	    fields[n] = f->name;
+	n++;
+    }
+    return n;
+}
+
+
+int FBSetCompareVar(const struct fb_var_screeninfo *cur,
+		    const struct fb_var_screeninfo *var, int flags,
+		    const char *fields[FBSET_VAR_FIELDS])
+{
+    return CompareVar(NULL, cur, var, flags, fields);
+}
+
+
+    /*
+     *  Set a Video Mode unless it is active already
+     *
+     *  Like FBSetApplyMode(), but with FB_ACTIVATE_NOW the device is left
+     *  alone if its video mode is the same as vmode, since many devices blank
+     *  the display while switching modes. FB_ACTIVATE_ALL always goes to the
+     *  device: it is for all consoles, the active mode only that of one.
+     *  changed tells whether a video mode was set.
+     */
+
+int FBSetUpdateMode(struct FBSet *fs, struct VideoMode *vmode, __u32 activate,
+		    int *changed)
+{
+    struct fb_var_screeninfo cur, var;
+    int res;
+
+    *changed = 0;
+    if (activate == FB_ACTIVATE_NOW) {
+	if ((res = FBSetGetVar(fs, &cur)))
+	    return res;
+	FBSetConvertFromVideoMode(vmode, &var);
+	Verbose(fs, "Comparing with the video mode of `%s'\n", fs->device);
+	if (!CompareVar(fs, &cur, &var, 0, NULL)) {
+	    Verbose(fs, "Video mode is active already, not set\n");
+	    FBSetConvertToVideoMode(&cur, vmode);
+	    return FBSET_OK;
+	}
+    }
+    if ((res = FBSetApplyMode(fs, vmode, activate)))
+	return res;
+    *changed = activate != FB_ACTIVATE_TEST;
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Conversion Routines
+     */
+
+void FBSetConvertFromVideoMode(const struct VideoMode *vmode,
+			       struct fb_var_screeninfo *var)
+{
+    memset(var, 0, sizeof(struct fb_var_screeninfo));
+    var->xres = vmode->xres;
+    var->yres = vmode->yres;
+    var->xres_virtual = vmode->vxres;
+    var->yres_virtual = vmode->vyres;
+    var->bits_per_pixel = vmode->depth;
+    var->nonstd = vmode->nonstd;
+    var->activate = FB_ACTIVATE_NOW;
+    var->accel_flags = vmode->accel_flags;
+    var->pixclock = vmode->pixclock;
+    var->left_margin = vmode->left;
+    var->right_margin = vmode->right;
+    var->upper_margin = vmode->upper;
+    var->lower_margin = vmode->lower;
+    var->hsync_len = vmode->hslen;
+    var->vsync_len = vmode->vslen;
+    if (vmode->hsync == HIGH)
+	var->sync |= FB_SYNC_HOR_HIGH_ACT;
+    if (vmode->vsync == HIGH)
+	var->sync |= FB_SYNC_VERT_HIGH_ACT;
+    if (vmode->csync == HIGH)
+	var->sync |= FB_SYNC_COMP_HIGH_ACT;
+    if (vmode->gsync == HIGH)
+	var->sync |= FB_SYNC_ON_GREEN;
+    if (vmode->extsync == TRUE)
+	var->sync |= FB_SYNC_EXT;
+    if (vmode->bcast == TRUE)
+	var->sync |= FB_SYNC_BROADCAST;
+    if (vmode->laced == TRUE)
+	var->vmode = FB_VMODE_INTERLACED;
+    else if (vmode->dblscan == TRUE)
+	var->vmode = FB_VMODE_DOUBLE;
+    else
+	var->vmode = FB_VMODE_NONINTERLACED;
+    var->vmode |= FB_VMODE_CONUPDATE;
+    var->red.length = vmode->red.length;
+    var->red.offset = vmode->red.offset;
+    var->green.length = vmode->green.length;
+    var->green.offset = vmode->green.offset;
+    var->blue.length = vmode->blue.length;
+    var->blue.offset = vmode->blue.offset;
+    var->transp.length = vmode->transp.length;
+    var->transp.offset = vmode->transp.offset;
+    var->grayscale = vmode->grayscale;
+}
+
+
+void FBSetConvertToVideoMode(const struct fb_var_screeninfo *var,
+			     struct VideoMode *vmode)
+{
+    vmode->name = NULL;
+    vmode->xres = var->xres;
+    vmode->yres = var->yres;
+    vmode->vxres = var->xres_virtual;
+    vmode->vyres = var->yres_virtual;
+    vmode->depth = var->bits_per_pixel;
+    vmode->nonstd = var->nonstd;
+    vmode->accel_flags = var->accel_flags;
+    vmode->pixclock = var->pixclock;
+    vmode->left = var->left_margin;
+    vmode->right = var->right_margin;
+    vmode->upper = var->upper_margin;
+    vmode->lower = var->lower_margin;
+    vmode->hslen = var->hsync_len;
+    vmode->vslen = var->vsync_len;
+    vmode->hsync = var->sync & FB_SYNC_HOR_HIGH_ACT ? HIGH : LOW;
+    vmode->vsync = var->sync & FB_SYNC_VERT_HIGH_ACT ? HIGH : LOW;
+    vmode->csync = var->sync & FB_SYNC_COMP_HIGH_ACT ? HIGH : LOW;
+    vmode->gsync = var->sync & FB_SYNC_ON_GREEN ? TRUE : FALSE;
+    vmode->extsync = var->sync & FB_SYNC_EXT ? TRUE : FALSE;
+    vmode->bcast = var->sync & FB_SYNC_BROADCAST ? TRUE : FALSE;
+    vmode->grayscale = var->grayscale;
+    vmode->laced = FALSE;
+    vmode->dblscan = FALSE;
+    switch (var->vmode & FB_VMODE_MASK) {
+	case FB_VMODE_INTERLACED:
+	    vmode->laced = TRUE;
+	    break;
+	case FB_VMODE_DOUBLE:
+	    vmode->dblscan = TRUE;
+	    break;
+    }
+    vmode->red.length = var->red.length;
+    vmode->red.offset = var->red.offset;
+    vmode->green.length = var->green.length;
+    vmode->green.offset = var->green.offset;
+    vmode->blue.length = var->blue.length;
+    vmode->blue.offset = var->blue.offset;
+    vmode->transp.length = var->transp.length;
+    vmode->transp.offset = var->transp.offset;
+    FBSetFillScanRates(vmode);
+}
+
+
+    /*
+     *  Returns -1 if var is not a boolean.
+     */
+
+static int atoboolean(const char *var)
+{
+    int value = 0;
+
+    if (!strcasecmp(var, "false") || !strcasecmp(var, "low") ||
+	!strcasecmp(var, "no") || !strcasecmp(var, "off") ||
+	!strcmp(var, "0"))
+	value = 0;
+    else if (!strcasecmp(var, "true") || !strcasecmp(var, "high") ||
+	     !strcasecmp(var, "yes") || !strcasecmp(var, "on") ||
+	     !strcmp(var, "1"))
+	value = 1;
+    else
+	value = -1;
+
+    return value;
+}
+
+
+static int getColor(struct color *color, const char** opt)
+{
+    char* ptr;
+
+    color->length = 0;
+    color->offset = 0;
+    ptr = (char*)(*opt);
+    if (!ptr)
+	return 0;
+    color->length = strtoul(ptr, &ptr, 0);
+    if (!ptr)
+	return 0;
+    if (*ptr == '/')
+	color->offset = strtoul(ptr+1, &ptr, 0);
+    if (ptr) {
+	while (*ptr && isspace(*ptr))
+	    ptr++;
+	if (*ptr == ',') {
+	    ptr++;
+	} else if (*ptr)
+	    return -1;
+    }
+    *opt = ptr;
+    return 0;
+}
+
+    /*
+     *  Returns -1 if opt is not an RGBA specification.
+     */
+
+int makeRGBA(struct VideoMode *vmode, const char* opt)
+{
+    if (getColor(&vmode->red, &opt) || getColor(&vmode->green, &opt) ||
+	getColor(&vmode->blue, &opt) || getColor(&vmode->transp, &opt))
+	return -1;
+    return 0;
+}
+
+
+int AddVideoMode(struct ModeParser *mp)
+{
+    struct VideoMode *vmode;
+
+    if (ModeDBFind(mp->db, mp->vmode.name))
+	return ModeDBFail(mp->db, FBSET_ERR_DATABASE,
+			  "%s:%d: Duplicate mode name `%s'", mp->file,
+			  mp->line, mp->vmode.name);
+    mp->vmode.file = mp->file;
+    if (!(vmode = ModeDBAdd(mp->db, &mp->vmode)))
+	return FBSET_ERR_NOMEM;
+    if (!FBSetFillScanRates(vmode))
+	return ModeDBFail(mp->db, FBSET_ERR_DATABASE,
+			  "%s:%d: Bad video mode `%s'", mp->file, mp->line,
+			  vmode->name);
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Read the Video Mode Database
+     *
+     *  Without paths, the default file and directory are read. If only is
+     *  given, that is the only mode needed: unless FBSET_LOAD_STRICT is set,
+     *  or the full parse can refresh the compiled database, only that mode is
+     *  looked up.
+     */
+
+static int ReadModes(struct FBSet *fs, int n, const char *const paths[],
+		     const char *cachefile, const char *only, int flags)
+{
+    static const char *const defaults[] = {
+	DEFAULT_MODEDBFILE, DEFAULT_MODEDBDIR
+    };
+    int optional = 0, error, i;
+    size_t size;
+
+    ModeDBFree(fs->db);
+    fs->db = NULL;
+    ModeCacheClose(&fs->cache);
+
+    if (!n) {
+	paths = defaults;
+	n = 2;
+	optional = 1;
+    }
+    for (i = 0; i < n; i++)
+	Verbose(fs, "Reading mode database from `%s'\n", paths[i]);
+
+    if (cachefile && ModeCacheOpen(&fs->cache, cachefile, n, paths)) {
+	Verbose(fs, "Using compiled mode database `%s'\n", cachefile);
+	return FBSET_OK;
+    }
+
+    if (!(fs->db = ModeDBCreate()))
+	return Fail(fs, FBSET_ERR_NOMEM, "No memory");
+
+    /*
+     *  Parsing everything only pays off if it refreshes the compiled
+     *  database, otherwise just look for the mode we need
+     */
+
+    if (only && !(flags & FBSET_LOAD_STRICT) &&
+	(!cachefile || !ModeCacheWritable(cachefile))) {
+	if ((error = LookupModeDB(fs->db, n, paths, optional, only)))
+	    return DatabaseFailed(fs, error);
+	Verbose(fs, "Looked up video mode `%s' without a full parse\n", only);
+	return FBSET_OK;
+    }
+
+    if ((error = LoadModeDB(fs->db, n, paths, optional)))
+	return DatabaseFailed(fs, error);
+
+    if (fs->db->nmodes) {
+	size = ModeDBMemory(fs->db);
+	Verbose(fs, "Read %u video modes using %lu bytes (%lu bytes per mode)\n",
+		fs->db->nmodes, (u_long)size, (u_long)(size/fs->db->nmodes));
+    }
+
+    if (cachefile) {
+	if (ModeCacheWrite(cachefile, fs->db))
+	    Verbose(fs, "Updated compiled mode database `%s'\n", cachefile);
+	else
+	    Verbose(fs, "Cannot update compiled mode database `%s': %s\n",
+		    cachefile, strerror(errno));
+    }
+    return FBSET_OK;
+}
+
+
+int FBSetLoadModes(struct FBSet *fs, int n, const char *const paths[],
+		   const char *cachefile, const char *only, int flags)
+{
+    unsigned long long start = Clock();
+    int res;
+
+    res = ReadModes(fs, n, paths, cachefile, only, flags);
+    Account(fs, FBSET_STAT_MODEDB, start);
+    return res;
+}
+
+
+    /*
+     *  Find a Video Mode
+     *
+     *  The strings in vmode stay valid until the database is loaded again or
+     *  the handle is destroyed.
+     */
+
+int FBSetFindMode(struct FBSet *fs, const char *name, struct VideoMode *vmode)
+{
+    unsigned long long start = Clock();
+    const struct VideoMode *found;
+
+    if (ModeCacheLookup(&fs->cache, name, vmode)) {
+	FBSetFillScanRates(vmode);
+	Account(fs, FBSET_STAT_MODEDB, start);
+	return FBSET_OK;
+    }
+
+    found = ModeDBFind(fs->db, name);
+    Account(fs, FBSET_STAT_MODEDB, start);
+    if (!found)
+	return Fail(fs, FBSET_ERR_NOMODE, "Unknown video mode `%s'", name);
+    *vmode = *found;
+    vmode->next = NULL;
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Call fn for every Video Mode in the Database, in File Order
+     *
+     *  Stops at the first call that returns non-zero, and returns that.
+     */
+
+int FBSetForEachMode(struct FBSet *fs,
+		     int (*fn)(const struct VideoMode *vmode, void *arg),
+		     void *arg)
+{
+    const struct VideoMode *found;
+    struct VideoMode vmode;
+    u_int i;
+    int res;
+
+    for (i = 0; ModeCacheGet(&fs->cache, i, &vmode); i++) {
+	FBSetFillScanRates(&vmode);
+	if ((res = fn(&vmode, arg)))
+	    return res;
+    }
+    for (found = fs->db ? fs->db->modes : NULL; found; found = found->next) {
+	vmode = *found;
+	vmode.next = NULL;
+	if ((res = fn(&vmode, arg)))
+	    return res;
+    }
+    return 0;
+}
+
+
+    /*
+     *  Modify a Video Mode
+     */
+
+    /*
+     *  Make Room for Buffers below each other in the Virtual Resolution
+     *
+     *  Each buffer starts at a multiple of the pan step. Lines are as long
+     *  as the device has them now if the virtual width and depth stay the
+     *  same, else at least as long as their pixels need.
+     */
+
+static int SizeBuffers(struct FBSet *fs, struct VideoMode *vmode,
+		       const char *buffers, const struct fb_var_screeninfo *cur,
+		       const struct fb_fix_screeninfo *fix)
+{
+    unsigned long long line, pitch, lines, n, fit = 0;
+    u_int step, vxres;
+    char *end;
+
+    vxres = vmode->vxres > vmode->xres ? vmode->vxres : vmode->xres;
+    if (vxres == cur->xres_virtual && vmode->depth == cur->bits_per_pixel &&
+	fix->line_length)
+	line = fix->line_length;
+    else
+	line = ((unsigned long long)vxres*vmode->depth+7)/8;
+    step = fix->ypanstep ? fix->ypanstep :
+	   fix->ywrapstep ? fix->ywrapstep : 1;
+    pitch = (vmode->yres+step-1)/step*step;
+    if (line && (lines = fix->smem_len/line) >= vmode->yres)
+	fit = (lines-vmode->yres)/pitch+1;
+
+    if (!strcmp(buffers, "max"))
+	n = fit;
+    else {
+	n = strtoul(buffers, &end, 0);
+	if (!n || *end)
+	    return Fail(fs, FBSET_ERR_INVALID, "Bad number of buffers `%s'",
+			buffers);
+    }
+    if (!n || n > fit)
+	return Fail(fs, FBSET_ERR_INVALID,
+		    "Not enough video memory for %llu buffer%s of %ux%u at %u "
+		    "bpp: %llu bytes needed, %u available", n ? n : 1,
+		    n > 1 ? "s" : "", vmode->xres, vmode->yres, vmode->depth,
+		    line*((n ? n-1 : 0)*pitch+vmode->yres), fix->smem_len);
+    vmode->vxres = vxres;
+    vmode->vyres = (n-1)*pitch+vmode->yres;
+    return FBSET_OK;
+}
+
+
+static int ModifyVideoMode(struct FBSet *fs, struct VideoMode *vmode,
+			   const struct FBSetModeOptions *opts,
+			   const struct fb_var_screeninfo *cur,
+			   const struct fb_fix_screeninfo *fix)
+{
+    const char *booleans[] = {
+	opts->accel, opts->hsync, opts->vsync, opts->csync, opts->gsync,
+	opts->extsync, opts->bcast, opts->laced, opts->double_,
+	opts->grayscale
+    };
+    u_int hstep = 8, vstep = 2;
+    int res, i;
+
+    for (i = 0; i < sizeof(booleans)/sizeof(*booleans); i++)
+	if (booleans[i] && atoboolean(booleans[i]) < 0)
+	    return Fail(fs, FBSET_ERR_INVALID, "Invalid value `%s'",
+			booleans[i]);
+
+    if (opts->xres)
+	vmode->xres = strtoul(opts->xres, NULL, 0);
+    if (opts->yres)
+	vmode->yres = strtoul(opts->yres, NULL, 0);
+    if (opts->vxres)
+	vmode->vxres = strtoul(opts->vxres, NULL, 0);
+    if (opts->vyres)
+	vmode->vyres = strtoul(opts->vyres, NULL, 0);
+    if (opts->depth)
+	vmode->depth = strtoul(opts->depth, NULL, 0);
+    if (opts->nonstd)
+	vmode->nonstd = strtoul(opts->nonstd, NULL, 0);
+    if (opts->accel)
+	vmode->accel_flags = atoboolean(opts->accel) ? FB_ACCELF_TEXT : 0;
+    if (opts->pixclock)
+	vmode->pixclock = strtoul(opts->pixclock, NULL, 0);
+    if (opts->left)
+	vmode->left = strtoul(opts->left, NULL, 0);
+    if (opts->right)
+	vmode->right = strtoul(opts->right, NULL, 0);
+    if (opts->upper)
+	vmode->upper = strtoul(opts->upper, NULL, 0);
+    if (opts->lower)
+	vmode->lower = strtoul(opts->lower, NULL, 0);
+    if (opts->hslen)
+	vmode->hslen = strtoul(opts->hslen, NULL, 0);
+    if (opts->vslen)
+	vmode->vslen = strtoul(opts->vslen, NULL, 0);
+    if (opts->hsync)
+	vmode->hsync = atoboolean(opts->hsync);
+    if (opts->vsync)
+	vmode->vsync = atoboolean(opts->vsync);
+    if (opts->csync)
+	vmode->csync = atoboolean(opts->csync);
+    if (opts->gsync)
+	vmode->gsync = atoboolean(opts->gsync);
+    if (opts->extsync)
+	vmode->extsync = atoboolean(opts->extsync);
+    if (opts->bcast)
+	vmode->bcast = atoboolean(opts->bcast);
+    if (opts->laced)
+	vmode->laced = atoboolean(opts->laced);
+    if (opts->double_)
+	vmode->dblscan = atoboolean(opts->double_);
+    if (opts->grayscale)
+	vmode->grayscale = atoboolean(opts->grayscale);
+    if (opts->step)
+	hstep = vstep = strtoul(opts->step, NULL, 0);
+    if (opts->matchyres)
+        vmode->vyres = vmode->yres;
+    if (opts->buffers &&
+	(res = SizeBuffers(fs, vmode, opts->buffers, cur, fix)))
+	return res;
+    if (opts->move) {
+	if (!strcasecmp(opts->move, "left")) {
+	    if (hstep > vmode->left)
+		return Fail(fs, FBSET_ERR_INVALID,
+			    "The left margin cannot be negative");
+	    vmode->left -= hstep;
+	    vmode->right += hstep;
+	} else if (!strcasecmp(opts->move, "right")) {
+	    if (hstep > vmode->right)
+		return Fail(fs, FBSET_ERR_INVALID,
+			    "The right margin cannot be negative");
+	    vmode->left += hstep;
+	    vmode->right -= hstep;
+	} else if (!strcasecmp(opts->move, "up")) {
+	    if (vstep > vmode->upper)
+		return Fail(fs, FBSET_ERR_INVALID,
+			    "The upper margin cannot be negative");
+	    vmode->upper -= vstep;
+	    vmode->lower += vstep;
+	} else if (!strcasecmp(opts->move, "down")) {
+	    if (vstep > vmode->lower)
+		return Fail(fs, FBSET_ERR_INVALID,
+			    "The lower margin cannot be negative");
+	    vmode->upper += vstep;
+	    vmode->lower -= vstep;
+	} else
+	    return Fail(fs, FBSET_ERR_INVALID, "Invalid direction `%s'",
+			opts->move);
+    }
+    if (opts->rgba && makeRGBA(vmode, opts->rgba))
+	return Fail(fs, FBSET_ERR_INVALID,
+		    "Bad RGBA syntax, rL/rO,gL/gO,bL/bO,tL/tO or rL,gL,bL,tL");
+    if (!FBSetFillScanRates(vmode))
+	return Fail(fs, FBSET_ERR_INVALID, "Bad video mode");
+    return FBSET_OK;
+}
+
+
+int FBSetModifyMode(struct FBSet *fs, struct VideoMode *vmode,
+		    const struct FBSetModeOptions *opts)
+{
+    struct VideoMode modified = *vmode;
+    struct fb_var_screeninfo cur;
+    struct fb_fix_screeninfo fix;
+    int res;
+
+    if (opts->buffers &&
+	((res = FBSetGetVar(fs, &cur)) || (res = FBSetGetFix(fs, &fix))))
+	return res;
+    if ((res = ModifyVideoMode(fs, &modified, opts, &cur, &fix)))
+	return res;
+    *vmode = modified;
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Calculate the Scan Rates for a Video Mode
+     */
+
+int FBSetFillScanRates(struct VideoMode *vmode)
+{
+    u_int htotal = vmode->left+vmode->xres+vmode->right+vmode->hslen;
+    u_int vtotal = vmode->upper+vmode->yres+vmode->lower+vmode->vslen;
+
+    if (vmode->dblscan)
+	vtotal <<= 2;
+    else if (!vmode->laced)
+	vtotal <<= 1;
+
+    if (!htotal || !vtotal)
+	return 0;
+
+    if (vmode->pixclock) {
+	vmode->drate = 1E12/vmode->pixclock;
+	vmode->hrate = vmode->drate/htotal;
+	vmode->vrate = vmode->hrate/vtotal*2;
+    } else {
+	vmode->drate = 0;
+	vmode->hrate = 0;
+	vmode->vrate = 0;
+    }
+
+    return 1;
+}
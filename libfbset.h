@@ -0,0 +1,229 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Frame Buffer Configuration Library
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Everything fbset does, as library calls on a handle that owns a frame
+ *  buffer device and a video mode database. No call prints anything unless
+ *  asked to, or exits: failures return one of the FBSET_ERR_* codes, and
+ *  FBSetErrorMessage() tells what went wrong. Handles do not share any
+ *  state, so different threads may use different handles.
+ */
+
+#ifndef _LIBFBSET_H
+#define _LIBFBSET_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifdef __GLIBC__
+#include <asm/types.h>
+#endif
+
+#include "fb.h"
+
+#define FBSET_API	__attribute__ ((visibility ("default")))
+
+#define FBSET_LOW	(0)		/* sync polarities */
+#define FBSET_HIGH	(1)
+
+struct color {
+    unsigned int length;
+    unsigned int offset;
+};
+
+struct VideoMode {
+    struct VideoMode *next;
+    const char *name;
+    const char *file;			/* database file it came from */
+    /* geometry */
+    __u32 xres;
+    __u32 yres;
+    __u32 vxres;
+    __u32 vyres;
+    __u32 depth;
+    __u32 nonstd;
+    /* acceleration */
+    __u32 accel_flags;
+    /* timings */
+    __u32 pixclock;
+    __u32 left;
+    __u32 right;
+    __u32 upper;
+    __u32 lower;
+    __u32 hslen;
+    __u32 vslen;
+    /* flags, FBSET_LOW or FBSET_HIGH for the syncs */
+    unsigned hsync : 1;
+    unsigned vsync : 1;
+    unsigned csync : 1;
+    unsigned gsync : 1;
+    unsigned extsync : 1;
+    unsigned bcast : 1;
+    unsigned laced : 1;
+    unsigned dblscan : 1;
+    unsigned grayscale : 1;
+    /* scanrates */
+    double drate;
+    double hrate;
+    double vrate;
+    /* RGB entries */
+    struct color red, green, blue, transp;
+};
+
+
+    /*
+     *  Error Codes
+     */
+
+#define FBSET_OK		0
+#define FBSET_ERR_DEVICE	1	/* opening or talking to the device */
+#define FBSET_ERR_DATABASE	2	/* reading the video mode database */
+#define FBSET_ERR_NOMODE	3	/* no such video mode */
+#define FBSET_ERR_INVALID	4	/* bad video mode or modification */
+#define FBSET_ERR_NOMEM		5
+
+
+    /*
+     *  Changes to a Video Mode
+     *
+     *  The values are given as on the fbset command line; NULL leaves a
+     *  parameter alone. Buffers are sized for the memory of the open device.
+     */
+
+struct FBSetModeOptions {
+    const char *xres;
+    const char *yres;
+    const char *vxres;
+    const char *vyres;
+    const char *depth;
+    const char *nonstd;
+    const char *accel;
+    const char *pixclock;
+    const char *left;
+    const char *right;
+    const char *upper;
+    const char *lower;
+    const char *hslen;
+    const char *vslen;
+    const char *hsync;
+    const char *vsync;
+    const char *csync;
+    const char *gsync;
+    const char *extsync;
+    const char *bcast;
+    const char *laced;
+    const char *double_;
+    const char *grayscale;
+    const char *rgba;
+    const char *move;			/* left, right, up or down */
+    const char *step;
+    const char *buffers;		/* buffers in vyres, or max */
+    int matchyres;			/* vyres = yres */
+};
+
+
+    /*
+     *  Loading Flags
+     */
+
+#define FBSET_LOAD_STRICT	0x0001	/* always parse and check everything */
+
+
+    /*
+     *  Comparing Screen Infos
+     */
+
+#define FBSET_COMPARE_EXACT	0x0001	/* the pixel clock too */
+#define FBSET_VAR_FIELDS	21	/* fields that are compared */
+
+
+    /*
+     *  Statistics
+     *
+     *  Every handle counts its calls of the kinds below and the time they
+     *  took, by CLOCK_MONOTONIC. The rest describes its video mode database.
+     */
+
+#define FBSET_STAT_MODEDB	0	/* loading the database, finding modes */
+#define FBSET_STAT_OPEN		1	/* opening the device */
+#define FBSET_STAT_GETVAR	2	/* FBIOGET_VSCREENINFO */
+#define FBSET_STAT_PUTVAR	3	/* FBIOPUT_VSCREENINFO */
+#define FBSET_STAT_GETFIX	4	/* FBIOGET_FSCREENINFO */
+#define FBSET_STAT_PAN		5	/* FBIOPAN_DISPLAY */
+#define FBSET_STATS		6
+
+struct FBSetStats {
+    u_int calls[FBSET_STATS];
+    unsigned long long nsecs[FBSET_STATS];
+    u_int nmodes;			/* video modes in the database */
+    size_t parsed;			/* bytes of database files read */
+    u_int allocs;			/* memory blocks allocated for it */
+    size_t memory;			/* bytes used by it */
+    int compiled;			/* the compiled database is used */
+};
+
+
+struct FBSet;
+
+    /* handles */
+extern struct FBSet *FBSetCreate(void) FBSET_API;
+extern void FBSetDestroy(struct FBSet *fs) FBSET_API;
+extern void FBSetVerbose(struct FBSet *fs, FILE *out) FBSET_API;
+extern const char *FBSetErrorMessage(const struct FBSet *fs) FBSET_API;
+extern void FBSetGetStats(const struct FBSet *fs, struct FBSetStats *stats)
+    FBSET_API;
+extern void FBSetClearStats(struct FBSet *fs) FBSET_API;
+
+    /* the video mode database */
+extern int FBSetLoadModes(struct FBSet *fs, int n, const char *const paths[],
+			  const char *cachefile, const char *only, int flags)
+    FBSET_API;
+extern int FBSetFindMode(struct FBSet *fs, const char *name,
+			 struct VideoMode *vmode) FBSET_API;
+extern int FBSetForEachMode(struct FBSet *fs,
+			    int (*fn)(const struct VideoMode *vmode, void *arg),
+			    void *arg) FBSET_API;
+
+    /* video modes */
+extern int FBSetModifyMode(struct FBSet *fs, struct VideoMode *vmode,
+			   const struct FBSetModeOptions *opts) FBSET_API;
+extern int FBSetFillScanRates(struct VideoMode *vmode) FBSET_API;
+extern void FBSetConvertFromVideoMode(const struct VideoMode *vmode,
+				      struct fb_var_screeninfo *var) FBSET_API;
+extern void FBSetConvertToVideoMode(const struct fb_var_screeninfo *var,
+				    struct VideoMode *vmode) FBSET_API;
+extern int FBSetCompareVar(const struct fb_var_screeninfo *cur,
+			   const struct fb_var_screeninfo *var, int flags,
+			   const char *fields[FBSET_VAR_FIELDS]) FBSET_API;
+
+    /* the frame buffer device */
+extern int FBSetOpenDevice(struct FBSet *fs, const char *name) FBSET_API;
+extern void FBSetCloseDevice(struct FBSet *fs) FBSET_API;
+extern int FBSetGetVar(struct FBSet *fs, struct fb_var_screeninfo *var)
+    FBSET_API;
+extern int FBSetPutVar(struct FBSet *fs, struct fb_var_screeninfo *var)
+    FBSET_API;
+extern int FBSetTestVar(struct FBSet *fs, struct fb_var_screeninfo *var)
+    FBSET_API;
+extern int FBSetProbeCache(struct FBSet *fs, const char *dir) FBSET_API;
+extern int FBSetGetFix(struct FBSet *fs, struct fb_fix_screeninfo *fix)
+    FBSET_API;
+extern int FBSetPanDisplay(struct FBSet *fs, struct fb_var_screeninfo *var)
+    FBSET_API;
+extern int FBSetMapMemory(struct FBSet *fs, int writable, void **mem,
+			  size_t *len) FBSET_API;
+extern void FBSetUnmapMemory(struct FBSet *fs) FBSET_API;
+extern int FBSetGetMode(struct FBSet *fs, struct VideoMode *vmode) FBSET_API;
+extern int FBSetApplyMode(struct FBSet *fs, struct VideoMode *vmode,
+			  __u32 activate) FBSET_API;
+extern int FBSetUpdateMode(struct FBSet *fs, struct VideoMode *vmode,
+			   __u32 activate, int *changed) FBSET_API;
+
+#endif /* _LIBFBSET_H */
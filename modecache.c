@@ -0,0 +1,455 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Compiled Video Mode Database
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  The compiled database is a flat image of a parsed mode database, meant to
+ *  be mapped into memory and used as is:
+ *
+ *	struct ModeCacheHeader	header
+ *	struct ModeCacheSource	sources[nsources]
+ *	struct ModeCacheEntry	entries[nmodes]
+ *	__u32			index[hashsize]	(entry number + 1, 0 = free)
+ *	char			strings[strsize]
+ *
+ *  The sources are the paths the database was loaded from, followed by every
+ *  file that was read, including drop-in files and included files, with the
+ *  identity each had at the time. A stale image is detected with one stat()
+ *  per source; a directory changes its identity when files are added to or
+ *  removed from it.
+ */
+
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fb.h"
+
+#include "fbset.h"
+
+
+#define MODECACHE_MAGIC		0x434d4246	/* "FBMC" */
+#define MODECACHE_VERSION	2
+
+#define MODECACHE_HSYNC		0x0001
+#define MODECACHE_VSYNC		0x0002
+#define MODECACHE_CSYNC		0x0004
+#define MODECACHE_GSYNC		0x0008
+#define MODECACHE_EXTSYNC	0x0010
+#define MODECACHE_BCAST		0x0020
+#define MODECACHE_LACED		0x0040
+#define MODECACHE_DBLSCAN	0x0080
+#define MODECACHE_GRAYSCALE	0x0100
+
+#define MODECACHE_ROOT		0x0001	/* source given to LoadModeDB() */
+
+struct ModeCacheHeader {
+    __u32 magic;
+    __u32 version;
+    /* layout */
+    __u32 nsources;
+    __u32 nmodes;
+    __u32 hashsize;			/* power of two */
+    __u32 strsize;
+};
+
+struct ModeCacheSource {
+    __u32 path;				/* offset in the string table */
+    __u32 flags;			/* MODECACHE_ROOT */
+    /* identity, all zero if missing */
+    __u64 dev;
+    __u64 ino;
+    __u64 size;
+    __u64 mtime;
+    __u32 mtime_nsec;
+    __u32 pad;
+};
+
+struct ModeCacheEntry {
+    __u32 name;				/* offset in the string table */
+    __u32 file;				/* offset in the string table */
+    __u32 xres;
+    __u32 yres;
+    __u32 vxres;
+    __u32 vyres;
+    __u32 depth;
+    __u32 nonstd;
+    __u32 accel_flags;
+    __u32 pixclock;
+    __u32 left;
+    __u32 right;
+    __u32 upper;
+    __u32 lower;
+    __u32 hslen;
+    __u32 vslen;
+    __u32 flags;			/* MODECACHE_* */
+    __u32 red_length, red_offset;
+    __u32 green_length, green_offset;
+    __u32 blue_length, blue_offset;
+    __u32 transp_length, transp_offset;
+};
+
+
+static void StampSource(struct ModeCacheSource *src, const struct stat *st)
+{
+    src->dev = st->st_dev;
+    src->ino = st->st_ino;
+    src->size = st->st_size;
+    src->mtime = st->st_mtim.tv_sec;
+    src->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+
+    /*
+     *  Check the Sources against the Paths Asked for and the File System
+     */
+
+static int SourcesValid(const struct ModeCacheSource *src, __u32 nsources,
+			const char *strings, __u32 strsize, int n,
+			const char *const paths[])
+{
+    struct ModeCacheSource stamp;
+    struct stat st;
+    int root = 0;
+
+    for (; nsources--; src++) {
+	if (src->path >= strsize)
+	    return 0;
+	if (src->flags & MODECACHE_ROOT &&
+	    (root >= n || strcmp(strings+src->path, paths[root++])))
+	    return 0;
+	if (stat(strings+src->path, &st))
+	    memset(&st, 0, sizeof(st));
+	memset(&stamp, 0, sizeof(stamp));
+	StampSource(&stamp, &st);
+	if (src->dev != stamp.dev || src->ino != stamp.ino ||
+	    src->size != stamp.size || src->mtime != stamp.mtime ||
+	    src->mtime_nsec != stamp.mtime_nsec)
+	    return 0;
+    }
+    return root == n;
+}
+
+
+    /*
+     *  Map the Compiled Database if it is Still Valid for the Paths
+     */
+
+int ModeCacheOpen(struct ModeCache *mc, const char *cachefile, int n,
+		  const char *const paths[])
+{
+    const struct ModeCacheHeader *hdr;
+    const struct ModeCacheSource *sources;
+    const char *strings;
+    struct stat st;
+    size_t size;
+    void *base;
+    int fd;
+
+    if ((fd = open(cachefile, O_RDONLY)) == -1)
+	return 0;
+    if (fstat(fd, &st) || st.st_size < sizeof(*hdr)) {
+	close(fd);
+	return 0;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+	return 0;
+
+    hdr = base;
+    if (hdr->magic != MODECACHE_MAGIC || hdr->version != MODECACHE_VERSION)
+	goto stale;
+    if (!hdr->hashsize || hdr->hashsize & (hdr->hashsize-1) ||
+	hdr->nmodes >= hdr->hashsize || !hdr->strsize)
+	goto stale;
+    size = sizeof(*hdr)+(size_t)hdr->nsources*sizeof(*sources)+
+	   (size_t)hdr->nmodes*sizeof(struct ModeCacheEntry)+
+	   (size_t)hdr->hashsize*sizeof(__u32)+hdr->strsize;
+    if (size != st.st_size)
+	goto stale;
+    sources = (const struct ModeCacheSource *)(hdr+1);
+    strings = (const char *)base+size-hdr->strsize;
+    if (strings[hdr->strsize-1] != '\0' ||
+	!SourcesValid(sources, hdr->nsources, strings, hdr->strsize, n, paths))
+	goto stale;
+
+    mc->base = base;
+    mc->size = size;
+    mc->nmodes = hdr->nmodes;
+    mc->hashsize = hdr->hashsize;
+    mc->strsize = hdr->strsize;
+    mc->entries = (const struct ModeCacheEntry *)(sources+hdr->nsources);
+    mc->index = (const __u32 *)(mc->entries+mc->nmodes);
+    mc->strings = strings;
+    return 1;
+
+stale:
+    munmap(base, st.st_size);
+    return 0;
+}
+
+
+void ModeCacheClose(struct ModeCache *mc)
+{
+    if (mc->base) {
+	munmap((void *)mc->base, mc->size);
+	mc->base = NULL;
+    }
+}
+
+
+    /*
+     *  Decode an Entry of the Compiled Database
+     */
+
+static int CacheEntryMode(const struct ModeCache *mc,
+			  const struct ModeCacheEntry *e, struct VideoMode *vmode)
+{
+    if (e->name >= mc->strsize || e->file >= mc->strsize)
+	return 0;
+
+    memset(vmode, 0, sizeof(*vmode));
+    vmode->name = mc->strings+e->name;
+    vmode->file = mc->strings+e->file;
+    vmode->xres = e->xres;
+    vmode->yres = e->yres;
+    vmode->vxres = e->vxres;
+    vmode->vyres = e->vyres;
+    vmode->depth = e->depth;
+    vmode->nonstd = e->nonstd;
+    vmode->accel_flags = e->accel_flags;
+    vmode->pixclock = e->pixclock;
+    vmode->left = e->left;
+    vmode->right = e->right;
+    vmode->upper = e->upper;
+    vmode->lower = e->lower;
+    vmode->hslen = e->hslen;
+    vmode->vslen = e->vslen;
+    vmode->hsync = e->flags & MODECACHE_HSYNC ? HIGH : LOW;
+    vmode->vsync = e->flags & MODECACHE_VSYNC ? HIGH : LOW;
+    vmode->csync = e->flags & MODECACHE_CSYNC ? HIGH : LOW;
+    vmode->gsync = e->flags & MODECACHE_GSYNC ? HIGH : LOW;
+    vmode->extsync = e->flags & MODECACHE_EXTSYNC ? TRUE : FALSE;
+    vmode->bcast = e->flags & MODECACHE_BCAST ? TRUE : FALSE;
+    vmode->laced = e->flags & MODECACHE_LACED ? TRUE : FALSE;
+    vmode->dblscan = e->flags & MODECACHE_DBLSCAN ? TRUE : FALSE;
+    vmode->grayscale = e->flags & MODECACHE_GRAYSCALE ? TRUE : FALSE;
+    vmode->red.length = e->red_length;
+    vmode->red.offset = e->red_offset;
+    vmode->green.length = e->green_length;
+    vmode->green.offset = e->green_offset;
+    vmode->blue.length = e->blue_length;
+    vmode->blue.offset = e->blue_offset;
+    vmode->transp.length = e->transp_length;
+    vmode->transp.offset = e->transp_offset;
+    return 1;
+}
+
+
+    /*
+     *  Look up a Mode in the Compiled Database
+     */
+
+int ModeCacheLookup(const struct ModeCache *mc, const char *name,
+		    struct VideoMode *vmode)
+{
+    const struct ModeCacheEntry *e;
+    __u32 i, slot;
+
+    if (!mc->base)
+	return 0;
+
+    for (i = HashModeName(name) & (mc->hashsize-1);
+	 (slot = mc->index[i]); i = (i+1) & (mc->hashsize-1)) {
+	if (slot > mc->nmodes)
+	    return 0;
+	e = &mc->entries[slot-1];
+	if (e->name >= mc->strsize || strcmp(mc->strings+e->name, name))
+	    continue;
+	return CacheEntryMode(mc, e, vmode);
+    }
+    return 0;
+}
+
+
+    /*
+     *  Get the Video Mode in Entry i
+     */
+
+int ModeCacheGet(const struct ModeCache *mc, u_int i, struct VideoMode *vmode)
+{
+    if (!mc->base || i >= mc->nmodes)
+	return 0;
+    return CacheEntryMode(mc, &mc->entries[i], vmode);
+}
+
+
+    /*
+     *  Compile a Parsed Database and Replace the Cache File Atomically
+     */
+
+int ModeCacheWrite(const char *cachefile, const struct ModeDB *db)
+{
+    const struct ModeSource *source;
+    const struct VideoMode *vmode;
+    struct ModeCacheHeader *hdr;
+    struct ModeCacheSource *src;
+    struct ModeCacheEntry *e;
+    __u32 nsources = 0, nmodes = 0, hashsize, strsize = 1, i, n;
+    size_t size;
+    char *image, *strings, *tmpname;
+    const char *file;
+    __u32 *index, fileoff;
+    int fd, res = 0;
+
+    /* mode files are recorded as sources, so they are stored only once */
+    for (source = db->sources; source; source = source->next) {
+	nsources++;
+	strsize += strlen(source->path)+1;
+    }
+    for (vmode = db->modes; vmode; vmode = vmode->next) {
+	nmodes++;
+	strsize += strlen(vmode->name)+1;
+    }
+    for (hashsize = 16; hashsize < 2*nmodes; hashsize <<= 1)
+	;
+
+    size = sizeof(*hdr)+(size_t)nsources*sizeof(*src)+
+	   (size_t)nmodes*sizeof(*e)+(size_t)hashsize*sizeof(*index)+strsize;
+    if (!(image = calloc(1, size)))
+	return 0;
+    hdr = (struct ModeCacheHeader *)image;
+    src = (struct ModeCacheSource *)(hdr+1);
+    e = (struct ModeCacheEntry *)(src+nsources);
+    index = (__u32 *)(e+nmodes);
+    strings = (char *)(index+hashsize);
+
+    hdr->magic = MODECACHE_MAGIC;
+    hdr->version = MODECACHE_VERSION;
+    hdr->nsources = nsources;
+    hdr->nmodes = nmodes;
+    hdr->hashsize = hashsize;
+    hdr->strsize = strsize;
+
+    /* offset 0 is the empty string */
+    strsize = 1;
+    for (source = db->sources; source; source = source->next, src++) {
+	src->path = strsize;
+	strcpy(strings+strsize, source->path);
+	strsize += strlen(source->path)+1;
+	src->flags = source->root ? MODECACHE_ROOT : 0;
+	StampSource(src, &source->st);
+    }
+    src -= nsources;
+
+    file = NULL;
+    fileoff = 0;
+    for (vmode = db->modes, n = 0; vmode; vmode = vmode->next, n++, e++) {
+	if (vmode->file != file) {
+	    file = vmode->file;
+	    for (i = 0, fileoff = 0; file && i < nsources; i++)
+		if (!strcmp(strings+src[i].path, file)) {
+		    fileoff = src[i].path;
+		    break;
+		}
+	}
+	e->file = fileoff;
+	e->name = strsize;
+	strcpy(strings+strsize, vmode->name);
+	strsize += strlen(vmode->name)+1;
+	e->xres = vmode->xres;
+	e->yres = vmode->yres;
+	e->vxres = vmode->vxres;
+	e->vyres = vmode->vyres;
+	e->depth = vmode->depth;
+	e->nonstd = vmode->nonstd;
+	e->accel_flags = vmode->accel_flags;
+	e->pixclock = vmode->pixclock;
+	e->left = vmode->left;
+	e->right = vmode->right;
+	e->upper = vmode->upper;
+	e->lower = vmode->lower;
+	e->hslen = vmode->hslen;
+	e->vslen = vmode->vslen;
+	e->flags = (vmode->hsync ? MODECACHE_HSYNC : 0) |
+		   (vmode->vsync ? MODECACHE_VSYNC : 0) |
+		   (vmode->csync ? MODECACHE_CSYNC : 0) |
+		   (vmode->gsync ? MODECACHE_GSYNC : 0) |
+		   (vmode->extsync ? MODECACHE_EXTSYNC : 0) |
+		   (vmode->bcast ? MODECACHE_BCAST : 0) |
+		   (vmode->laced ? MODECACHE_LACED : 0) |
+		   (vmode->dblscan ? MODECACHE_DBLSCAN : 0) |
+		   (vmode->grayscale ? MODECACHE_GRAYSCALE : 0);
+	e->red_length = vmode->red.length;
+	e->red_offset = vmode->red.offset;
+	e->green_length = vmode->green.length;
+	e->green_offset = vmode->green.offset;
+	e->blue_length = vmode->blue.length;
+	e->blue_offset = vmode->blue.offset;
+	e->transp_length = vmode->transp.length;
+	e->transp_offset = vmode->transp.offset;
+
+	for (i = HashModeName(vmode->name) & (hashsize-1); index[i];
+	     i = (i+1) & (hashsize-1))
+	    ;
+	index[i] = n+1;
+    }
+
+    if (!(tmpname = malloc(strlen(cachefile)+8)))
+	goto out;
+    sprintf(tmpname, "%s.XXXXXX", cachefile);
+    if ((fd = mkstemp(tmpname)) == -1)
+	goto out_name;
+    if (fchmod(fd, 0644) || write(fd, image, size) != size) {
+	close(fd);
+	goto out_unlink;
+    }
+    if (close(fd) || rename(tmpname, cachefile))
+	goto out_unlink;
+    res = 1;
+    goto out_name;
+
+out_unlink:
+    i = errno;
+    unlink(tmpname);
+    errno = i;
+out_name:
+    free(tmpname);
+out:
+    free(image);
+    return res;
+}
+
+
+    /*
+     *  Check whether ModeCacheWrite() can Replace the Cache File
+     */
+
+int ModeCacheWritable(const char *cachefile)
+{
+    const char *slash = strrchr(cachefile, '/');
+    char *dir;
+    int res;
+
+    if (!slash)
+	return !access(".", W_OK);
+    if (slash == cachefile)
+	return !access("/", W_OK);
+    if (!(dir = strndup(cachefile, slash-cachefile)))
+	return 0;
+    res = !access(dir, W_OK);
+    free(dir);
+    return res;
+}
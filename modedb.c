@@ -0,0 +1,914 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Video Mode Database Storage
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  All objects created while parsing a database live in two bump arenas
+ *  owned by the database: one for the mode records, so they end up next to
+ *  each other in file order, and one for interned strings. Database files
+ *  are mapped and scanned in place, so mode names and rgba specifications
+ *  are views into a mapping, which the database owns as well. Freeing the
+ *  database releases everything at once.
+ *
+ *  Databases do not share any state, so several files can be parsed into
+ *  separate databases in parallel and merged afterwards. A database also
+ *  records every file and directory it was read from, so a compiled copy can
+ *  tell whether it is still up to date.
+ *
+ *  Functions that can fail return an FBSET_ERR_* code, or NULL for out of
+ *  memory, and leave the message of the error in the database. Whatever they
+ *  allocated themselves is freed again; the rest goes with the database.
+ */
+
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fb.h"
+
+#include "fbset.h"
+
+
+#define ARENA_MIN_CHUNK		(16*1024)
+#define ARENA_MAX_CHUNK		(1024*1024)
+#define ARENA_ALIGN		(sizeof(void *) > sizeof(double) ? \
+				 sizeof(void *) : sizeof(double))
+
+#define MAX_INCLUDE_DEPTH	8
+
+struct ModeArenaChunk {
+    struct ModeArenaChunk *next;
+    size_t size;
+};
+
+struct ModeDBMapping {
+    struct ModeDBMapping *next;
+    void *addr;
+    size_t len;
+};
+
+
+    /*
+     *  Hash a String (32-bit FNV-1a)
+     */
+
+__u32 HashString(const char *s, size_t len)
+{
+    __u32 hash = 2166136261U;
+
+    while (len--) {
+	hash ^= (unsigned char)*s++;
+	hash *= 16777619U;
+    }
+    return hash;
+}
+
+
+__u32 HashModeName(const char *name)
+{
+    return HashString(name, strlen(name));
+}
+
+
+    /*
+     *  Record the Error of a Database Function
+     */
+
+int ModeDBFail(struct ModeDB *db, int error, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(db->error, sizeof(db->error), fmt, ap);
+    va_end(ap);
+    return error;
+}
+
+
+static int NoMemory(struct ModeDB *db)
+{
+    return ModeDBFail(db, FBSET_ERR_NOMEM, "No memory");
+}
+
+
+    /*
+     *  Bump Allocation
+     */
+
+static void *ArenaAlloc(struct ModeArena *arena, size_t size, size_t align)
+{
+    struct ModeArenaChunk *chunk;
+    size_t chunksize;
+    char *p;
+
+    p = (char *)(((unsigned long)arena->next+align-1) & ~(align-1));
+    if (!arena->next || p+size > arena->end) {
+	chunksize = arena->chunks ? 2*arena->chunks->size : ARENA_MIN_CHUNK;
+	if (chunksize > ARENA_MAX_CHUNK)
+	    chunksize = ARENA_MAX_CHUNK;
+	if (chunksize < sizeof(*chunk)+ARENA_ALIGN+size)
+	    chunksize = sizeof(*chunk)+ARENA_ALIGN+size;
+	if (!(chunk = malloc(chunksize)))
+	    return NULL;
+	chunk->next = arena->chunks;
+	chunk->size = chunksize;
+	arena->chunks = chunk;
+	arena->reserved += chunksize;
+	arena->nchunks++;
+	arena->next = (char *)(chunk+1);
+	arena->end = (char *)chunk+chunksize;
+	p = (char *)(((unsigned long)arena->next+align-1) & ~(align-1));
+    }
+    arena->next = p+size;
+    arena->used += size;
+    return p;
+}
+
+
+static void ArenaSplice(struct ModeArena *arena, struct ModeArena *from)
+{
+    struct ModeArenaChunk *last;
+
+    if (!from->chunks)
+	return;
+    if (!arena->chunks) {
+	*arena = *from;
+    } else {
+	/* keep allocating from our current chunk */
+	for (last = from->chunks; last->next; last = last->next)
+	    ;
+	last->next = arena->chunks->next;
+	arena->chunks->next = from->chunks;
+	arena->used += from->used;
+	arena->reserved += from->reserved;
+	arena->nchunks += from->nchunks;
+    }
+    memset(from, 0, sizeof(*from));
+}
+
+
+static void ArenaFree(struct ModeArena *arena)
+{
+    struct ModeArenaChunk *chunk;
+
+    while ((chunk = arena->chunks)) {
+	arena->chunks = chunk->next;
+	free(chunk);
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+
+    /*
+     *  Create and Destroy a Database
+     */
+
+struct ModeDB *ModeDBCreate(void)
+{
+    struct ModeDB *db;
+
+    if (!(db = calloc(1, sizeof(*db))))
+	return NULL;
+    db->tail = &db->modes;
+    db->sourcetail = &db->sources;
+    db->allocs = 1;
+    return db;
+}
+
+
+void ModeDBFree(struct ModeDB *db)
+{
+    struct ModeDBMapping *map;
+
+    if (!db)
+	return;
+    for (map = db->mappings; map; map = map->next)
+	munmap(map->addr, map->len);
+    ArenaFree(&db->records);
+    ArenaFree(&db->strings);
+    free(db->index);
+    free(db->strindex);
+    free(db);
+}
+
+
+    /*
+     *  Map a Database File
+     *
+     *  The file is mapped private and writable, so the scanner can terminate
+     *  tokens in place without touching the file. The mapping is followed by
+     *  at least two NUL bytes: either the zero fill of the last file page, or
+     *  an anonymous page reserved behind it.
+     */
+
+char *ModeDBMapFile(struct ModeDB *db, int fd, size_t size)
+{
+    struct ModeDBMapping *map;
+    size_t pagesize = getpagesize();
+    size_t len = (size+2+pagesize-1) & ~(pagesize-1);
+    void *addr;
+
+    addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+	return NULL;
+    if (size && mmap(addr, size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+	munmap(addr, len);
+	return NULL;
+    }
+
+    if (!(map = ArenaAlloc(&db->records, sizeof(*map), ARENA_ALIGN))) {
+	munmap(addr, len);
+	errno = ENOMEM;
+	return NULL;
+    }
+    map->addr = addr;
+    map->len = len;
+    map->next = db->mappings;
+    db->mappings = map;
+    db->parsed += size;
+    return addr;
+}
+
+
+    /*
+     *  Intern a String
+     */
+
+const char *ModeDBString(struct ModeDB *db, const char *s, size_t len)
+{
+    const char **index, *s2;
+    u_int size, i, j;
+    char *p;
+
+    if (2*(db->nstrings+1) > db->strindexsize) {
+	size = db->strindexsize ? 2*db->strindexsize : 64;
+	if (!(index = calloc(size, sizeof(*index)))) {
+	    NoMemory(db);
+	    return NULL;
+	}
+	for (j = 0; j < db->strindexsize; j++) {
+	    if (!(s2 = db->strindex[j]))
+		continue;
+	    for (i = HashModeName(s2) & (size-1); index[i]; i = (i+1) & (size-1))
+		;
+	    index[i] = s2;
+	}
+	free(db->strindex);
+	db->strindex = index;
+	db->strindexsize = size;
+	db->allocs++;
+    }
+
+    for (i = HashString(s, len) & (db->strindexsize-1); (s2 = db->strindex[i]);
+	 i = (i+1) & (db->strindexsize-1))
+	if (!strncmp(s2, s, len) && !s2[len])
+	    return s2;
+
+    if (!(p = ArenaAlloc(&db->strings, len+1, 1))) {
+	NoMemory(db);
+	return NULL;
+    }
+    memcpy(p, s, len);
+    p[len] = '\0';
+    db->strindex[i] = p;
+    db->nstrings++;
+    return p;
+}
+
+
+    /*
+     *  Add a Video Mode
+     *
+     *  The name index uses open addressing with linear probing and is kept at
+     *  most half full; the list of modes stays in file order. Room for n
+     *  modes is made in advance, so linking them cannot fail.
+     */
+
+static int ModeDBReserve(struct ModeDB *db, u_int n)
+{
+    struct VideoMode **index, *vmode2;
+    u_int size, i, j;
+
+    if (2*n > db->indexsize) {
+	for (size = db->indexsize ? 2*db->indexsize : 64; 2*n > size;
+	     size *= 2)
+	    ;
+	if (!(index = calloc(size, sizeof(*index))))
+	    return NoMemory(db);
+	for (j = 0; j < db->indexsize; j++) {
+	    if (!(vmode2 = db->index[j]))
+		continue;
+	    for (i = HashModeName(vmode2->name) & (size-1); index[i];
+		 i = (i+1) & (size-1))
+		;
+	    index[i] = vmode2;
+	}
+	free(db->index);
+	db->index = index;
+	db->indexsize = size;
+	db->allocs++;
+    }
+    return FBSET_OK;
+}
+
+static void ModeDBLink(struct ModeDB *db, struct VideoMode *vmode)
+{
+    u_int i;
+
+    vmode->next = NULL;
+    *db->tail = vmode;
+    db->tail = &vmode->next;
+
+    for (i = HashModeName(vmode->name) & (db->indexsize-1); db->index[i];
+	 i = (i+1) & (db->indexsize-1))
+	;
+    db->index[i] = vmode;
+    db->nmodes++;
+}
+
+
+struct VideoMode *ModeDBAdd(struct ModeDB *db, const struct VideoMode *vmode)
+{
+    struct VideoMode *vmode2;
+
+    if (ModeDBReserve(db, db->nmodes+1))
+	return NULL;
+    if (!(vmode2 = ArenaAlloc(&db->records, sizeof(*vmode2), ARENA_ALIGN))) {
+	NoMemory(db);
+	return NULL;
+    }
+    *vmode2 = *vmode;
+    ModeDBLink(db, vmode2);
+    return vmode2;
+}
+
+
+    /*
+     *  Find a Video Mode
+     */
+
+struct VideoMode *ModeDBFind(const struct ModeDB *db, const char *name)
+{
+    struct VideoMode *vmode;
+    u_int i;
+
+    if (!db || !db->indexsize)
+	return NULL;
+
+    for (i = HashModeName(name) & (db->indexsize-1); (vmode = db->index[i]);
+	 i = (i+1) & (db->indexsize-1))
+	if (!strcmp(name, vmode->name))
+	    break;
+
+    return vmode;
+}
+
+
+    /*
+     *  Merge a Database into Another One
+     *
+     *  The modes of from are appended to db, and db takes over all its memory.
+     *  A mode whose name is already present in db replaces the old definition
+     *  in place. Returns the number of modes replaced, or -1 if db cannot
+     *  take them, in which case both databases are left as they were.
+     */
+
+int ModeDBMerge(struct ModeDB *db, struct ModeDB *from)
+{
+    struct VideoMode *vmode, *old, *next;
+    struct ModeDBMapping *map;
+    int replaced = 0;
+
+    if (ModeDBReserve(db, db->nmodes+from->nmodes))
+	return -1;
+    for (vmode = from->modes; vmode; vmode = next) {
+	next = vmode->next;
+	if ((old = ModeDBFind(db, vmode->name))) {
+	    vmode->next = old->next;
+	    *old = *vmode;
+	    replaced++;
+	} else
+	    ModeDBLink(db, vmode);
+    }
+    ArenaSplice(&db->records, &from->records);
+    ArenaSplice(&db->strings, &from->strings);
+    if ((map = from->mappings)) {
+	while (map->next)
+	    map = map->next;
+	map->next = db->mappings;
+	db->mappings = from->mappings;
+    }
+    if (from->sources) {
+	*db->sourcetail = from->sources;
+	db->sourcetail = from->sourcetail;
+    }
+    db->parsed += from->parsed;
+    db->allocs += from->allocs;
+    free(from->index);
+    free(from->strindex);
+    free(from);
+    return replaced;
+}
+
+
+    /*
+     *  Record a File or Directory the Database was Read from
+     */
+
+int ModeDBAddSource(struct ModeDB *db, const char *path,
+		    const struct stat *st, int root)
+{
+    struct ModeSource *src;
+
+    if (!(src = ArenaAlloc(&db->records, sizeof(*src), ARENA_ALIGN)))
+	return NoMemory(db);
+    src->next = NULL;
+    if (!(src->path = ModeDBString(db, path, strlen(path))))
+	return FBSET_ERR_NOMEM;
+    src->root = root;
+    src->st = *st;
+    *db->sourcetail = src;
+    db->sourcetail = &src->next;
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Intern dir/name, with len the length of dir
+     */
+
+static const char *JoinPath(struct ModeDB *db, const char *dir, size_t len,
+			    const char *name)
+{
+    const char *path;
+    char *buf;
+
+    while (len && dir[len-1] == '/')
+	len--;
+    if (!(buf = malloc(len+strlen(name)+2))) {
+	NoMemory(db);
+	return NULL;
+    }
+    memcpy(buf, dir, len);
+    buf[len] = '/';
+    strcpy(buf+len+1, name);
+    path = ModeDBString(db, buf, strlen(buf));
+    free(buf);
+    return path;
+}
+
+
+    /*
+     *  Parse a Video Mode Database File
+     *
+     *  mp->file must be interned in mp->db, as the modes refer to it. A
+     *  failure is recorded in mp->error as well.
+     */
+
+static char *MapModeFile(struct ModeParser *mp, size_t *len)
+{
+    struct stat st;
+    char *buf;
+    int fd;
+
+    if ((fd = open(mp->file, O_RDONLY)) == -1) {
+	mp->error = ModeDBFail(mp->db, FBSET_ERR_DATABASE, "open %s: %s",
+			       mp->file, strerror(errno));
+	return NULL;
+    }
+    if (fstat(fd, &st)) {
+	mp->error = ModeDBFail(mp->db, FBSET_ERR_DATABASE, "fstat %s: %s",
+			       mp->file, strerror(errno));
+	close(fd);
+	return NULL;
+    }
+    buf = ModeDBMapFile(mp->db, fd, st.st_size);
+    if (!buf)
+	mp->error = ModeDBFail(mp->db, FBSET_ERR_DATABASE, "mmap %s: %s",
+			       mp->file, strerror(errno));
+    close(fd);
+    if (!buf || (mp->error = ModeDBAddSource(mp->db, mp->file, &st, 0)))
+	return NULL;
+    *len = st.st_size;
+    mp->line = 1;
+    return buf;
+}
+
+static int ParseModeInto(struct ModeParser *mp)
+{
+    size_t len;
+    char *buf;
+
+    if (!(buf = MapModeFile(mp, &len)))
+	return mp->error;
+    return ParseModeBuffer(mp, buf, len);
+}
+
+
+    /*
+     *  Every call has its own parser and scanner state.
+     */
+
+int ParseModeFile(struct ModeDB *db, const char *file)
+{
+    struct ModeParser mp;
+
+    memset(&mp, 0, sizeof(mp));
+    mp.db = db;
+    if (!(mp.file = ModeDBString(db, file, strlen(file))))
+	return FBSET_ERR_NOMEM;
+    return ParseModeInto(&mp);
+}
+
+
+    /*
+     *  Handle an `include' Directive
+     *
+     *  Relative names are taken relative to the including file. The modes of
+     *  the included file go into the same database, so they must not repeat a
+     *  name of the including file either.
+     */
+
+static int InitInclude(struct ModeParser *inc, struct ModeParser *mp,
+		       const char *name, size_t len)
+{
+    const char *slash;
+    char *buf;
+
+    if (mp->depth >= MAX_INCLUDE_DEPTH)
+	return ModeDBFail(mp->db, FBSET_ERR_DATABASE,
+			  "%s:%d: Includes nested too deeply", mp->file,
+			  mp->line);
+    memset(inc, 0, sizeof(*inc));
+    inc->db = mp->db;
+    inc->depth = mp->depth+1;
+    if (!(buf = malloc(len+1)))
+	return NoMemory(mp->db);
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    if (buf[0] != '/' && (slash = strrchr(mp->file, '/')))
+	inc->file = JoinPath(mp->db, mp->file, slash-mp->file, buf);
+    else
+	inc->file = ModeDBString(mp->db, buf, len);
+    free(buf);
+    return inc->file ? FBSET_OK : FBSET_ERR_NOMEM;
+}
+
+int IncludeModeFile(struct ModeParser *mp, const char *name)
+{
+    struct ModeParser inc;
+    int error;
+
+    if ((error = InitInclude(&inc, mp, name, strlen(name))))
+	return error;
+    return ParseModeInto(&inc);
+}
+
+
+    /*
+     *  Look up a Single Mode in a Video Mode Database File
+     *
+     *  Only the tokens are skimmed: `mode' and `include' directives are
+     *  followed, the bodies of other modes are skipped up to their `endmode'
+     *  without being checked. The first mode of the requested name is parsed
+     *  and validated, and nothing after it is read. Anything unexpected
+     *  outside a mode body makes us parse the whole file instead, to get the
+     *  usual diagnostics. found is left NULL if the mode is not there.
+     */
+
+#define SKIM_TOP	0		/* between modes */
+#define SKIM_NAME	1		/* after `mode' */
+#define SKIM_BODY	2		/* inside a mode */
+#define SKIM_INCLUDE	3		/* after `include' */
+
+static int FindModeInto(struct ModeParser *mp, const char *name,
+			struct VideoMode **found)
+{
+    struct ModeParser inc, full;
+    char *buf, *p, *end, *q, *entry = NULL;
+    int state = SKIM_TOP, match = 0, line = 0, error;
+    size_t len, namelen;
+
+    *found = NULL;
+    if (!(buf = MapModeFile(mp, &len)))
+	return mp->error;
+    for (p = buf, end = buf+len; p < end; p = q) {
+	q = p+1;
+	switch (*p) {
+	    case '\n':
+		mp->line++;
+		/* fall through */
+	    case ' ':
+	    case '\t':
+		continue;
+
+	    case '#':
+		if (!(q = memchr(p, '\n', end-p)))
+		    q = end;
+		continue;
+
+	    case '"':
+		while (q < end && *q != '"' && *q != '\n')
+		    q++;
+		if (q == end || *q != '"')
+		    break;
+		q++;
+		if (state == SKIM_NAME) {
+		    namelen = q-p-2;
+		    match = !strncmp(p+1, name, namelen) && !name[namelen];
+		    state = SKIM_BODY;
+		} else if (state == SKIM_INCLUDE) {
+		    if ((error = InitInclude(&inc, mp, p+1, q-p-2)) ||
+			(error = FindModeInto(&inc, name, found)) || *found)
+			return error;
+		    state = SKIM_TOP;
+		} else if (state != SKIM_BODY)
+		    break;
+		continue;
+
+	    default:
+		while ((*q >= 'a' && *q <= 'z') || (*q >= 'A' && *q <= 'Z') ||
+		       (*q >= '0' && *q <= '9'))
+		    q++;
+		if (state == SKIM_BODY) {
+		    if (q-p != 7 || strncasecmp(p, "endmode", 7))
+			continue;
+		    if (!match) {
+			state = SKIM_TOP;
+			continue;
+		    }
+		    /* the parser needs two NUL bytes behind the entry */
+		    q[0] = q[1] = '\0';
+		    mp->line = line;
+		    if ((error = ParseModeBuffer(mp, entry, q-entry)))
+			return error;
+		    *found = ModeDBFind(mp->db, name);
+		    return FBSET_OK;
+		}
+		if (state != SKIM_TOP)
+		    break;
+		if (q-p == 4 && !strncasecmp(p, "mode", 4)) {
+		    entry = p;
+		    line = mp->line;
+		    state = SKIM_NAME;
+		    continue;
+		}
+		if (q-p == 7 && !strncasecmp(p, "include", 7)) {
+		    state = SKIM_INCLUDE;
+		    continue;
+		}
+		break;
+	}
+	break;
+    }
+    if (p == end && state == SKIM_TOP)
+	return FBSET_OK;
+
+    /*
+     *  Something unexpected, or an unterminated mode. Includes we skimmed may
+     *  have added modes already, so parse into a new database.
+     */
+    memset(&full, 0, sizeof(full));
+    if (!(full.db = ModeDBCreate()))
+	return NoMemory(mp->db);
+    full.depth = mp->depth;
+    full.line = 1;
+    error = FBSET_ERR_NOMEM;
+    if ((full.file = ModeDBString(full.db, mp->file, strlen(mp->file))))
+	error = ParseModeBuffer(&full, buf, len);
+    if (error)
+	ModeDBFail(mp->db, error, "%s", full.db->error);
+    else if (ModeDBMerge(mp->db, full.db) < 0)
+	error = FBSET_ERR_NOMEM;
+    else {
+	*found = ModeDBFind(mp->db, name);
+	return FBSET_OK;
+    }
+    ModeDBFree(full.db);
+    return error;
+}
+
+
+    /*
+     *  Parse Several Video Mode Database Files in Parallel into db
+     *
+     *  One thread per file, each with a database of its own; the results are
+     *  merged in the order of files[], so a mode defined again in a later
+     *  file replaces the earlier one. An error in any file is reported once
+     *  all threads are done, for the first file that failed.
+     */
+
+struct ModeLoad {
+    pthread_t thread;
+    int threaded;
+    const char *file;
+    struct ModeDB *db;			/* NULL if out of memory */
+    int error;
+};
+
+static void *ModeLoadThread(void *arg)
+{
+    struct ModeLoad *load = arg;
+
+    if (!(load->db = ModeDBCreate()))
+	load->error = FBSET_ERR_NOMEM;
+    else
+	load->error = ParseModeFile(load->db, load->file);
+    return NULL;
+}
+
+int ParseModeFiles(struct ModeDB *db, int n, const char *const files[])
+{
+    struct ModeLoad *loads;
+    int error = FBSET_OK, i;
+
+    if (!(loads = calloc(n ? n : 1, sizeof(*loads))))
+	return NoMemory(db);
+    for (i = 0; i < n; i++) {
+	loads[i].file = files[i];
+	loads[i].threaded = n > 1 &&
+			    !pthread_create(&loads[i].thread, NULL,
+					    ModeLoadThread, &loads[i]);
+	if (!loads[i].threaded)
+	    ModeLoadThread(&loads[i]);
+    }
+
+    for (i = 0; i < n; i++)
+	if (loads[i].threaded)
+	    pthread_join(loads[i].thread, NULL);
+
+    for (i = 0; i < n; i++) {
+	if (!error && loads[i].error)
+	    error = loads[i].db ? ModeDBFail(db, loads[i].error, "%s",
+					     loads[i].db->error)
+				: NoMemory(db);
+	else if (!error && ModeDBMerge(db, loads[i].db) < 0)
+	    error = FBSET_ERR_NOMEM;
+	else if (!error)
+	    continue;			/* db took it over */
+	ModeDBFree(loads[i].db);
+    }
+    free(loads);
+    return error;
+}
+
+
+    /*
+     *  Load a Video Mode Database
+     *
+     *  Every path is either a database file or a directory, of which all
+     *  *.modes files are read in alphabetical order, into db. Later files
+     *  override earlier ones. Missing paths are skipped if optional is set,
+     *  as long as at least one path exists.
+     */
+
+static int SelectModeFile(const struct dirent *d)
+{
+    size_t len = strlen(d->d_name);
+
+    return d->d_name[0] != '.' && len > 6 &&
+	   !strcmp(d->d_name+len-6, ".modes");
+}
+
+static int ExpandModePaths(struct ModeDB *db, int n,
+			   const char *const paths[], int optional,
+			   const char ***result, int *nfiles)
+{
+    struct dirent **entries;
+    const char **files = NULL, **old;
+    struct stat st;
+    int missing = 0, error, i, j, k;
+
+    *nfiles = 0;
+    for (i = 0; i < n; i++) {
+	if (stat(paths[i], &st)) {
+	    if (!optional || errno != ENOENT)
+		return ModeDBFail(db, FBSET_ERR_DATABASE, "stat %s: %s",
+				  paths[i], strerror(errno));
+	    memset(&st, 0, sizeof(st));
+	    if ((error = ModeDBAddSource(db, paths[i], &st, 1)))
+		return error;
+	    missing++;
+	    continue;
+	}
+	if ((error = ModeDBAddSource(db, paths[i], &st, 1)))
+	    return error;
+	if (!S_ISDIR(st.st_mode)) {
+	    k = 1;
+	    entries = NULL;
+	} else if ((k = scandir(paths[i], &entries, SelectModeFile,
+				alphasort)) < 0)
+	    return ModeDBFail(db, FBSET_ERR_DATABASE, "scandir %s: %s",
+			      paths[i], strerror(errno));
+	/* there are only a few paths, so just reallocate in the arena */
+	old = files;
+	if (!(files = ArenaAlloc(&db->records, (*nfiles+k+1)*sizeof(*files),
+				 ARENA_ALIGN)))
+	    error = NoMemory(db);
+	else if (*nfiles)
+	    memcpy(files, old, *nfiles*sizeof(*files));
+	if (!entries) {
+	    if (error)
+		return error;
+	    files[(*nfiles)++] = paths[i];
+	    continue;
+	}
+	for (j = 0; j < k; j++) {
+	    if (!error &&
+		!(files[(*nfiles)++] = JoinPath(db, paths[i], strlen(paths[i]),
+						entries[j]->d_name)))
+		error = FBSET_ERR_NOMEM;
+	    free(entries[j]);
+	}
+	free(entries);
+	if (error)
+	    return error;
+    }
+    if (n && missing == n)
+	return ModeDBFail(db, FBSET_ERR_DATABASE, "stat %s: %s", paths[0],
+			  strerror(ENOENT));
+    *result = files;
+    return FBSET_OK;
+}
+
+int LoadModeDB(struct ModeDB *db, int n, const char *const paths[],
+	       int optional)
+{
+    const char **files;
+    int nfiles, error;
+
+    if ((error = ExpandModePaths(db, n, paths, optional, &files, &nfiles)))
+	return error;
+    return ParseModeFiles(db, nfiles, files);
+}
+
+
+    /*
+     *  Look up a Single Mode in a Video Mode Database
+     *
+     *  Same paths and override order as LoadModeDB(), but the files are
+     *  skimmed from the last one backwards, and reading stops at the first
+     *  definition found. Duplicate names are not detected, and db need not
+     *  get more than the requested mode.
+     */
+
+int LookupModeDB(struct ModeDB *db, int n, const char *const paths[],
+		 int optional, const char *name)
+{
+    struct ModeParser mp;
+    struct VideoMode *found = NULL;
+    const char **files;
+    int nfiles, error;
+
+    if ((error = ExpandModePaths(db, n, paths, optional, &files, &nfiles)))
+	return error;
+    while (!found && nfiles--) {
+	memset(&mp, 0, sizeof(mp));
+	mp.db = db;
+	if (!(mp.file = ModeDBString(db, files[nfiles],
+				     strlen(files[nfiles]))))
+	    return FBSET_ERR_NOMEM;
+	if ((error = FindModeInto(&mp, name, &found)))
+	    return error;
+    }
+    return FBSET_OK;
+}
+
+
+    /*
+     *  Memory Used by a Database
+     */
+
+size_t ModeDBMemory(const struct ModeDB *db)
+{
+    return db->records.reserved+db->strings.reserved+
+	   db->indexsize*sizeof(*db->index)+
+	   db->strindexsize*sizeof(*db->strindex)+sizeof(*db);
+}
+
+
+    /*
+     *  Memory Blocks Allocated for a Database
+     */
+
+u_int ModeDBAllocs(const struct ModeDB *db)
+{
+    return db->records.nchunks+db->strings.nchunks+db->allocs;
+}
@@ -23,26 +23,26 @@
 #include "fb.h"
 #include "fbset.h"
 
-extern int yylex(void);
-extern void yyerror(const char *s);
-extern int line;
+extern int yylex(YYSTYPE *lvalp, void *scanner);
 
 
-static struct VideoMode VideoMode;
-
-static void ClearVideoMode(void)
+static void ClearVideoMode(struct ModeParser *mp)
 {
-    memset(&VideoMode, 0, sizeof(VideoMode));
-    VideoMode.accel_flags = FB_ACCELF_TEXT;
+    memset(&mp->vmode, 0, sizeof(mp->vmode));
+    mp->vmode.accel_flags = FB_ACCELF_TEXT;
 }
 
 %}
 
+%define api.pure full
+%parse-param {struct ModeParser *mp} {void *scanner}
+%lex-param {void *scanner}
+
 %start file
 
 %token MODE GEOMETRY TIMINGS HSYNC VSYNC CSYNC GSYNC EXTSYNC BCAST LACED DOUBLE
        RGBA NONSTD ACCEL GRAYSCALE
-       ENDMODE POLARITY BOOLEAN STRING NUMBER 
+       ENDMODE INCLUDE POLARITY BOOLEAN STRING NUMBER 
 
 %%
 
@@ -52,36 +52,45 @@ file	  : vmodes
 
 vmodes	  : /* empty */
 	  | vmodes vmode
+	  | vmodes include
+	  ;
+
+include	  : INCLUDE STRING
+	    {
+		if ((mp->error = IncludeModeFile(mp, (const char *)$2)))
+		    YYABORT;
+	    }
 	  ;
 
 vmode	  : MODE STRING geometry timings options ENDMODE
 	    {
-		VideoMode.name = (const char *)$2;
-		AddVideoMode(&VideoMode);
-		ClearVideoMode();
+		mp->vmode.name = (const char *)$2;
+		if ((mp->error = AddVideoMode(mp)))
+		    YYABORT;
+		ClearVideoMode(mp);
 	    }
 	  ;
 
 geometry  : GEOMETRY NUMBER NUMBER NUMBER NUMBER NUMBER
 	    {
-		ClearVideoMode();
-		VideoMode.xres = $2;
-		VideoMode.yres = $3;
-		VideoMode.vxres = $4;
-		VideoMode.vyres = $5;
-		VideoMode.depth = $6;
+		ClearVideoMode(mp);
+		mp->vmode.xres = $2;
+		mp->vmode.yres = $3;
+		mp->vmode.vxres = $4;
+		mp->vmode.vyres = $5;
+		mp->vmode.depth = $6;
 	    }
 	  ;
 
 timings	  : TIMINGS NUMBER NUMBER NUMBER NUMBER NUMBER NUMBER NUMBER
 	    {
-		VideoMode.pixclock = $2;
-		VideoMode.left = $3;
-		VideoMode.right = $4;
-		VideoMode.upper = $5;
-		VideoMode.lower = $6;
-		VideoMode.hslen = $7;
-		VideoMode.vslen = $8;
+		mp->vmode.pixclock = $2;
+		mp->vmode.left = $3;
+		mp->vmode.right = $4;
+		mp->vmode.upper = $5;
+		mp->vmode.lower = $6;
+		mp->vmode.hslen = $7;
+		mp->vmode.vslen = $8;
 	    }
 	  ;
 
@@ -102,73 +111,78 @@ options	  : /* empty */
 
 hsync	  : HSYNC POLARITY
 	    {
-		VideoMode.hsync = $2;
+		mp->vmode.hsync = $2;
 	    }
 	  ;
 
 vsync	  : VSYNC POLARITY
 	    {
-		VideoMode.vsync = $2;
+		mp->vmode.vsync = $2;
 	    }
 	  ;
 
 csync	  : CSYNC POLARITY
 	    {
-		VideoMode.csync = $2;
+		mp->vmode.csync = $2;
 	    }
 	  ;
 
 gsync	  : GSYNC POLARITY
 	    {
-		VideoMode.gsync = $2;
+		mp->vmode.gsync = $2;
 	    }
 	  ;
 
 extsync	  : EXTSYNC BOOLEAN
 	    {
-		VideoMode.extsync = $2;
+		mp->vmode.extsync = $2;
 	    }
 	  ;
 
 bcast	  : BCAST BOOLEAN
 	    {
-		VideoMode.bcast = $2;
+		mp->vmode.bcast = $2;
 	    }
 	  ;
 
 laced	  : LACED BOOLEAN
 	    {
-		VideoMode.laced = $2;
+		mp->vmode.laced = $2;
 	    }
 	  ;
 
 double	  : DOUBLE BOOLEAN
 	    {
-		VideoMode.dblscan = $2;
+		mp->vmode.dblscan = $2;
 	    }
 	  ;
 
 rgba      : RGBA STRING
             {
-		makeRGBA(&VideoMode, (const char*)$2);
+		if (makeRGBA(&mp->vmode, (const char*)$2)) {
+		    mp->error = ModeDBFail(mp->db, FBSET_ERR_DATABASE,
+					   "%s:%d: Bad RGBA syntax `%s'",
+					   mp->file, mp->line, (const char*)$2);
+		    YYABORT;
+		}
 	    }
 	  ;
 
 nonstd    : NONSTD NUMBER
             {
-	    	VideoMode.nonstd = $2;
+	    	mp->vmode.nonstd = $2;
 	    }
 	  ;
 
 accel	  : ACCEL BOOLEAN
 	    {
-		VideoMode.accel_flags = $2;
+		mp->vmode.accel_flags = $2;
 	    }
 	  ;
 
 grayscale : GRAYSCALE BOOLEAN
 	    {
-		VideoMode.grayscale = $2;
+		mp->vmode.grayscale = $2;
 	    }
 	  ;
 	  
@@ -0,0 +1,293 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Hand-Written Video Mode Database Scanner
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  A drop-in replacement for the flex scanner in modes.l (make SCANNER=fast).
+ *  It returns exactly the same token stream, but finds the end of blanks,
+ *  comments, strings and numbers 16 bytes at a time with SSE2, and converts
+ *  numbers without strtoul(). Runs are short, so wider vectors do not pay
+ *  off: AVX2 scanned no faster.
+ *
+ *  tests/scanners.sh checks that both scanners give the same tokens.
+ *
+ *  Vector loads are aligned, so they never cross into a page that does not
+ *  hold part of the buffer, and every run stops at the NUL bytes that
+ *  terminate the buffer.
+ */
+
+
+#define YYSTYPE		long
+
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "fbset.h"
+#include "modes.tab.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_WIDTH	16
+typedef __m128i scanvec;
+#define VLOAD(p)	_mm_load_si128((const __m128i *)(p))
+#define VSET(c)		_mm_set1_epi8(c)
+#define VEQ(a, b)	_mm_cmpeq_epi8(a, b)
+#define VGT(a, b)	_mm_cmpgt_epi8(a, b)
+#define VOR(a, b)	_mm_or_si128(a, b)
+#define VAND(a, b)	_mm_and_si128(a, b)
+#define VMASK(v)	((u_int)_mm_movemask_epi8(v))
+#endif
+
+
+struct ModeScanner {
+    struct ModeParser *mp;
+    char *pos;
+    char *end;
+};
+
+
+    /*
+     *  Runs of Characters
+     */
+
+#define RUN_BLANK	0	/* ' ' and '\t' */
+#define RUN_DIGIT	1	/* '0'-'9' */
+#define RUN_COMMENT	2	/* anything but '\n' */
+#define RUN_STRING	3	/* anything but '"' and '\n' */
+
+static inline int InRun(char c, int run)
+{
+    switch (run) {
+	case RUN_BLANK:
+	    return c == ' ' || c == '\t';
+	case RUN_DIGIT:
+	    return c >= '0' && c <= '9';
+	case RUN_COMMENT:
+	    return c && c != '\n';
+	default:
+	    return c && c != '"' && c != '\n';
+    }
+}
+
+#ifdef SCAN_WIDTH
+static inline u_int RunEndMask(scanvec v, int run)
+{
+    u_int mask;
+
+    switch (run) {
+	case RUN_BLANK:
+	    mask = ~VMASK(VOR(VEQ(v, VSET(' ')), VEQ(v, VSET('\t'))));
+	    break;
+	case RUN_DIGIT:
+	    /* bytes >= 0x80 compare as negative, so they are not digits */
+	    mask = ~VMASK(VAND(VGT(v, VSET('0'-1)), VGT(VSET('9'+1), v)));
+	    break;
+	case RUN_COMMENT:
+	    mask = VMASK(VOR(VEQ(v, VSET('\n')), VEQ(v, VSET(0))));
+	    break;
+	default:
+	    mask = VMASK(VOR(VOR(VEQ(v, VSET('"')), VEQ(v, VSET('\n'))),
+			     VEQ(v, VSET(0))));
+	    break;
+    }
+    return mask & ((1U << SCAN_WIDTH)-1);
+}
+#endif
+
+    /*
+     *  Return the first character after the run starting at p. Embedded NUL
+     *  bytes end comments and strings as well; the caller checks whether the
+     *  end of the buffer has been reached.
+     */
+
+static inline char *SkipRun(char *p, int run)
+{
+#ifdef SCAN_WIDTH
+    char *q = (char *)((unsigned long)p & ~(unsigned long)(SCAN_WIDTH-1));
+    u_int mask = RunEndMask(VLOAD(q), run) >> (p-q);
+
+    while (!mask) {
+	p = q += SCAN_WIDTH;
+	mask = RunEndMask(VLOAD(q), run);
+    }
+    return p+__builtin_ctz(mask);
+#else
+    while (InRun(*p, run))
+	p++;
+    return p;
+#endif
+}
+
+
+    /*
+     *  Convert a Run of Digits
+     *
+     *  Same result as strtoul(s, NULL, 0) on the run: a leading zero selects
+     *  octal (stopping at the first 8 or 9), and overflow saturates.
+     */
+
+static unsigned long ScanNumber(const char *s, const char *end,
+				const char *limit)
+{
+    unsigned long val = 0, digit, base = 10;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    unsigned long long chunk;
+#endif
+
+    if (*s == '0') {
+	base = 8;
+	s++;
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    else if (end-s <= 8 && s+8 <= limit) {
+	/*
+	 *  Up to 8 decimal digits at once: load them (and whatever follows, up
+	 *  to the NUL bytes behind the buffer), shift out what follows, then
+	 *  combine neighbouring digits, pairs and quads in one word
+	 */
+	memcpy(&chunk, s, 8);
+	chunk = (chunk-0x3030303030303030ULL) << (8*(8-(end-s)));
+	chunk = (chunk*10+(chunk >> 8)) & 0x00ff00ff00ff00ffULL;
+	chunk = (chunk*100+(chunk >> 16)) & 0x0000ffff0000ffffULL;
+	chunk = (chunk*10000+(chunk >> 32)) & 0x00000000ffffffffULL;
+	return chunk;
+    }
+#endif
+    for (; s < end; s++) {
+	digit = *s-'0';
+	if (digit >= base)
+	    break;
+	if (val > (ULONG_MAX-digit)/base)
+	    return ULONG_MAX;
+	val = val*base+digit;
+    }
+    return val;
+}
+
+
+    /*
+     *  The Scanner
+     *
+     *  An invalid token is recorded in the parser, and ends the input.
+     */
+
+static int InvalidToken(struct ModeScanner *ms, const char *token, int len)
+{
+    struct ModeParser *mp = ms->mp;
+
+    mp->error = ModeDBFail(mp->db, FBSET_ERR_DATABASE,
+			   "%s:%d: Invalid token `%.*s'", mp->file, mp->line,
+			   len, token);
+    ms->pos = ms->end;
+    return 0;
+}
+
+int yylex(YYSTYPE *lvalp, void *scanner)
+{
+    struct ModeScanner *ms = scanner;
+    struct ModeParser *mp = ms->mp;
+    char *p = ms->pos, *q;
+
+    for (;;) {
+	p = SkipRun(p, RUN_BLANK);
+	if (p >= ms->end) {
+	    ms->pos = p;
+	    return 0;
+	}
+	switch (*p) {
+	    case '\n':
+		mp->line++;
+		p++;
+		continue;
+
+	    case '#':
+		/* like flex' `{comment}$', a comment needs its newline */
+		for (q = p+1; (q = SkipRun(q, RUN_COMMENT)) < ms->end && !*q;
+		     q++)
+		    ;
+		if (q >= ms->end)
+		    return InvalidToken(ms, p, 1);
+		p = q;
+		continue;
+
+	    case '"':
+		for (q = p+1; (q = SkipRun(q, RUN_STRING)) < ms->end && !*q;
+		     q++)
+		    ;
+		if (*q != '"')
+		    return InvalidToken(ms, p, 1);
+		*q = '\0';
+		*lvalp = (unsigned long)(p+1);
+		ms->pos = q+1;
+		return STRING;
+
+	    case '0' ... '9':
+		q = SkipRun(p, RUN_DIGIT);
+		*lvalp = ScanNumber(p, q, ms->end+2);
+		ms->pos = q;
+		return NUMBER;
+
+	    case 'a' ... 'z':
+	    case 'A' ... 'Z':
+		for (q = p+1; (*q >= 'a' && *q <= 'z') ||
+			      (*q >= 'A' && *q <= 'Z') ||
+			      (*q >= '0' && *q <= '9'); q++)
+		    ;
+		ms->pos = q;
+		return FindToken(mp, p, q-p, lvalp);
+
+	    default:
+		return InvalidToken(ms, p, 1);
+	}
+    }
+}
+
+
+    /*
+     *  Parse a Database in Place
+     *
+     *  buf must be writable and followed by two NUL bytes. Returns
+     *  mp->error.
+     */
+
+int ParseModeBuffer(struct ModeParser *mp, char *buf, size_t len)
+{
+    struct ModeScanner ms;
+
+    ms.mp = mp;
+    ms.pos = buf;
+    ms.end = buf+len;
+    if (yyparse(mp, &ms) && !mp->error)
+	mp->error = FBSET_ERR_DATABASE;
+    return mp->error;
+}
+
+
+    /*
+     *  Only Scan a Database in Place
+     *
+     *  fn gets every token with its value, until it returns non-zero. Returns
+     *  mp->error.
+     */
+
+int ScanModeBuffer(struct ModeParser *mp, char *buf, size_t len,
+		   int (*fn)(int token, long value, void *arg), void *arg)
+{
+    struct ModeScanner ms;
+    YYSTYPE value;
+    int token;
+
+    ms.mp = mp;
+    ms.pos = buf;
+    ms.end = buf+len;
+    while ((token = yylex(&value, &ms)) && !fn(token, value, arg))
+	;
+    return mp->error;
+}
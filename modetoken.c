@@ -0,0 +1,117 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Video Mode Database Keywords
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Shared by the flex scanner (modes.l) and the hand-written one (modescan.c).
+ */
+
+
+#define YYSTYPE		long
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "fbset.h"
+#include "modes.tab.h"
+
+
+struct keyword {
+    const char *name;
+    int token;
+    int value;
+};
+
+static struct keyword keywords[] = {
+    { "mode", MODE, 0 },
+    { "geometry", GEOMETRY, 0 },
+    { "timings", TIMINGS, 0 },
+    { "hsync", HSYNC, 0 },
+    { "vsync", VSYNC, 0 },
+    { "csync", CSYNC, 0 },
+    { "gsync", GSYNC, 0 },
+    { "extsync", EXTSYNC, 0 },
+    { "bcast", BCAST, 0 },
+    { "laced", LACED, 0 },
+    { "double", DOUBLE, 0 },
+    { "rgba", RGBA, 0 },
+    { "nonstd", NONSTD, 0 },
+    { "accel", ACCEL, 0 },
+    { "grayscale", GRAYSCALE, 0 },
+    { "endmode", ENDMODE, 0 },
+    { "low", POLARITY, LOW },
+    { "high", POLARITY, HIGH },
+    { "false", BOOLEAN, FALSE },
+    { "true", BOOLEAN, TRUE },
+    { "include", INCLUDE, 0 },
+};
+
+
+    /*
+     *  Perfect hash over the keywords above, in the style of gperf: the sum of
+     *  the length and the values of the first and last letters is unique for
+     *  every keyword. Letters that do not start or end a keyword map beyond
+     *  the table. Any change to keywords[] must regenerate both tables.
+     */
+
+#define MIN_KEYWORD_LEN		3
+#define MAX_KEYWORD_LEN		9
+#define MAX_KEYWORD_HASH	37
+
+static const unsigned char keyword_asso[26] = {
+     3,  9, 14,  4,  8,  6,  7, 13, 21, 38, 38,  5, 13,
+     1, 38, 38, 38,  1,  2,  8, 38, 18,  4, 38, 16, 38
+};
+
+static const signed char keyword_index[MAX_KEYWORD_HASH+1] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, 11, -1, -1, 12, 16,
+    13,  9, -1, -1,  2, 10, 18, 19, -1,  8, 15, 14,  0,
+     6, -1, -1,  7, 17,  1,  3,  5, -1, -1, 20,  4
+};
+
+    /*
+     *  Only the first error of a parse is kept.
+     */
+
+void yyerror(struct ModeParser *mp, void *scanner, const char *s)
+{
+    if (!mp->error)
+	mp->error = ModeDBFail(mp->db, FBSET_ERR_DATABASE, "%s:%d: %s",
+			       mp->file, mp->line, s);
+}
+
+
+    /*
+     *  Look up a Keyword
+     *
+     *  s need not be NUL terminated. An unknown keyword is recorded in the
+     *  parser, and ends the input.
+     */
+
+int FindToken(struct ModeParser *mp, const char *s, int len, long *value)
+{
+    int hash, i;
+
+    /* keywords start with a letter, but may end in a digit */
+    if (len >= MIN_KEYWORD_LEN && len <= MAX_KEYWORD_LEN &&
+	isalpha((unsigned char)s[len-1])) {
+	hash = len+keyword_asso[tolower((unsigned char)s[0])-'a']+
+	       keyword_asso[tolower((unsigned char)s[len-1])-'a'];
+	if (hash <= MAX_KEYWORD_HASH && (i = keyword_index[hash]) >= 0 &&
+	    !strncasecmp(s, keywords[i].name, len) && !keywords[i].name[len]) {
+	    *value = keywords[i].value;
+	    return keywords[i].token;
+	}
+    }
+    mp->error = ModeDBFail(mp->db, FBSET_ERR_DATABASE,
+			   "%s:%d: Unknown keyword `%.*s'", mp->file, mp->line,
+			   len, s);
+    return 0;
+}
@@ -0,0 +1,409 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Pixel Formats
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Converts packed true color pixels, as described by the bitfields of the
+ *  screen info, to 8 bit RGB and back. Channels of less than 8 bits are
+ *  widened by repeating their bits, and of more than 8 bits cut to their
+ *  top 8 bits.
+ *
+ *  Pixels of 16 and 32 bits whose channels have at least 4 bits are
+ *  converted to RGB 4 (SSE2) or 8 (AVX2, if the processor has it) at a time
+ *  with shifts and masks; the rest, like 24 bit pixels, one by one.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "fbset.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+    /*
+     *  Widen a Channel of bits Bits to 8 Bits
+     */
+
+static __u8 WidenChannel(u_int v, u_int bits)
+{
+    if (bits >= 4)
+	/* the same as the vector code */
+	return (v << (8-bits)) | (v >> (2*bits-8));
+    return (v*255+(1 << bits)/2)/((1 << bits)-1);
+}
+
+
+    /*
+     *  One Pixel at a Time
+     */
+
+static void ScalarToRGB(const struct PixelFormat *pf, __u8 *rgb,
+			const __u8 *src, u_int n)
+{
+    __u32 pixel = 0;
+    __u16 pixel16;
+    u_int c;
+
+    while (n--) {
+	switch (pf->bytes) {
+	    case 1:
+		pixel = src[0];
+		break;
+	    case 2:
+		memcpy(&pixel16, src, 2);
+		pixel = pixel16;
+		break;
+	    case 3:
+		pixel = src[0] | src[1] << 8 | src[2] << 16;
+		break;
+	    case 4:
+		memcpy(&pixel, src, 4);
+		break;
+	}
+	for (c = 0; c < 3; c++)
+	    *rgb++ = pf->widen[c][(pixel >> pf->shift[c]) &
+				  ((1U << pf->bits[c])-1)];
+	src += pf->bytes;
+    }
+}
+
+
+#if defined(__SSE2__)
+
+    /*
+     *  4 Pixels at a Time
+     *
+     *  Each channel is shifted down, masked and widened in every 32 bit lane.
+     *  The lanes, now RGB0, are packed to RGB in pairs by shifting the odd
+     *  ones down a byte, and the two halves stored 6 bytes apart. Writes up
+     *  to 2 bytes beyond the 12 of the pixels.
+     */
+
+static inline __m128i WidenSSE2(__m128i pixels, __m128i shift, u_int bits)
+{
+    __m128i v = _mm_and_si128(_mm_srl_epi32(pixels, shift),
+			      _mm_set1_epi32((1 << bits)-1));
+
+    return _mm_or_si128(_mm_slli_epi32(v, 8-bits),
+			_mm_srli_epi32(v, 2*bits-8));
+}
+
+
+static inline void PackSSE2(const struct PixelFormat *pf, __u8 *rgb,
+			    __m128i pixels)
+{
+    __m128i v;
+
+    v = _mm_or_si128(
+	    WidenSSE2(pixels, _mm_cvtsi32_si128(pf->shift[0]), pf->bits[0]),
+	    _mm_or_si128(
+		_mm_slli_epi32(WidenSSE2(pixels,
+					 _mm_cvtsi32_si128(pf->shift[1]),
+					 pf->bits[1]), 8),
+		_mm_slli_epi32(WidenSSE2(pixels,
+					 _mm_cvtsi32_si128(pf->shift[2]),
+					 pf->bits[2]), 16)));
+    v = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi64x(0xffffffULL)),
+		     _mm_and_si128(_mm_srli_epi64(v, 8),
+				   _mm_set1_epi64x(0xffffff000000ULL)));
+    _mm_storel_epi64((__m128i *)rgb, v);
+    _mm_storel_epi64((__m128i *)(rgb+6), _mm_srli_si128(v, 8));
+}
+
+
+static u_int SSE2ToRGB(const struct PixelFormat *pf, __u8 *rgb,
+		       const __u8 *src, u_int n)
+{
+    __m128i v, zero = _mm_setzero_si128();
+    u_int i;
+
+    if (pf->bytes == 4) {
+	for (i = 0; i+4 <= n; i += 4, rgb += 12)
+	    PackSSE2(pf, rgb, _mm_loadu_si128((const __m128i *)(src+4*i)));
+    } else {
+	for (i = 0; i+8 <= n; i += 8, rgb += 24) {
+	    v = _mm_loadu_si128((const __m128i *)(src+2*i));
+	    PackSSE2(pf, rgb, _mm_unpacklo_epi16(v, zero));
+	    PackSSE2(pf, rgb+12, _mm_unpackhi_epi16(v, zero));
+	}
+    }
+    return i;
+}
+
+#endif /* __SSE2__ */
+
+
+#ifdef HAVE_AVX2
+
+    /*
+     *  8 Pixels at a Time
+     *
+     *  Each channel is shifted down, masked and widened in every 32 bit lane,
+     *  and the lanes, now RGB0, are packed to RGB by a shuffle. Writes up to
+     *  4 bytes beyond the 24 of the pixels.
+     */
+
+static inline TARGET_AVX2 __m256i WidenAVX2(__m256i pixels, __m128i shift,
+					     u_int bits)
+{
+    __m256i v = _mm256_and_si256(_mm256_srl_epi32(pixels, shift),
+				 _mm256_set1_epi32((1 << bits)-1));
+
+    return _mm256_or_si256(_mm256_slli_epi32(v, 8-bits),
+			   _mm256_srli_epi32(v, 2*bits-8));
+}
+
+
+static inline TARGET_AVX2 void PackAVX2(const struct PixelFormat *pf,
+					 __u8 *rgb, __m256i pixels)
+{
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13,
+					  14, -1, -1, -1, -1, 0, 1, 2, 4, 5,
+					  6, 8, 9, 10, 12, 13, 14, -1, -1, -1,
+					  -1);
+    __m256i v;
+
+    v = _mm256_or_si256(
+	    WidenAVX2(pixels, _mm_cvtsi32_si128(pf->shift[0]), pf->bits[0]),
+	    _mm256_or_si256(
+		_mm256_slli_epi32(WidenAVX2(pixels,
+					    _mm_cvtsi32_si128(pf->shift[1]),
+					    pf->bits[1]), 8),
+		_mm256_slli_epi32(WidenAVX2(pixels,
+					    _mm_cvtsi32_si128(pf->shift[2]),
+					    pf->bits[2]), 16)));
+    v = _mm256_shuffle_epi8(v, pack);
+    _mm_storeu_si128((__m128i *)rgb, _mm256_castsi256_si128(v));
+    _mm_storeu_si128((__m128i *)(rgb+12), _mm256_extracti128_si256(v, 1));
+}
+
+
+static TARGET_AVX2 u_int AVX2ToRGB(const struct PixelFormat *pf, __u8 *rgb,
+				   const __u8 *src, u_int n)
+{
+    u_int i;
+
+    for (i = 0; i+8 <= n; i += 8, rgb += 24)
+	if (pf->bytes == 4)
+	    PackAVX2(pf, rgb, _mm256_loadu_si256((const __m256i *)(src+4*i)));
+	else
+	    PackAVX2(pf, rgb, _mm256_cvtepu16_epi32(
+			  _mm_loadu_si128((const __m128i *)(src+2*i))));
+    return i;
+}
+
+#endif /* HAVE_AVX2 */
+
+
+    /*
+     *  Describe the Pixels of a Screen Info
+     *
+     *  Returns -1 if they are not packed 8, 16, 24 or 32 bit true color
+     *  pixels.
+     */
+
+int PixelFormatInit(struct PixelFormat *pf, const struct fb_var_screeninfo *var)
+{
+    const struct fb_bitfield *field[3] = { &var->red, &var->green, &var->blue };
+    u_int c, v;
+    int vector;
+
+    memset(pf, 0, sizeof(*pf));
+    if (var->bits_per_pixel % 8 || !var->bits_per_pixel ||
+	var->bits_per_pixel > 32)
+	return -1;
+    pf->bytes = var->bits_per_pixel/8;
+    vector = pf->bytes == 2 || pf->bytes == 4;
+    if (var->transp.length &&
+	var->transp.offset+var->transp.length <= var->bits_per_pixel)
+	pf->opaque = (__u32)((1ULL << var->transp.length)-1) <<
+		     var->transp.offset;
+    for (c = 0; c < 3; c++) {
+	if (!field[c]->length ||
+	    field[c]->offset+field[c]->length > var->bits_per_pixel)
+	    return -1;
+	pf->offset[c] = field[c]->offset;
+	pf->length[c] = field[c]->length;
+	pf->bits[c] = field[c]->length < 8 ? field[c]->length : 8;
+	pf->shift[c] = field[c]->offset+field[c]->length-pf->bits[c];
+	if (pf->bits[c] < 4)
+	    vector = 0;
+	for (v = 0; v < 1U << pf->bits[c]; v++)
+	    pf->widen[c][v] = WidenChannel(v, pf->bits[c]);
+    }
+#if defined(__SSE2__)
+    if (vector)
+	pf->vector = SSE2ToRGB;
+#endif
+#ifdef HAVE_AVX2
+    if (vector && HaveAVX2())
+	pf->vector = AVX2ToRGB;
+#endif
+    return 0;
+}
+
+
+    /*
+     *  Convert n Pixels to RGB
+     *
+     *  rgb needs PIXEL_SLACK bytes more than the 3*n it receives.
+     */
+
+void PixelsToRGB(const struct PixelFormat *pf, __u8 *rgb, const void *src,
+		 u_int n)
+{
+    u_int i = 0;
+
+    if (pf->vector)
+	i = pf->vector(pf, rgb, src, n);
+    ScalarToRGB(pf, rgb+3*i, (const __u8 *)src+i*pf->bytes, n-i);
+}
+
+
+    /*
+     *  Make a Pixel from RGB
+     *
+     *  Channels are cut or widened to their lengths, and the pixel is
+     *  opaque.
+     */
+
+__u32 PixelFromRGB(const struct PixelFormat *pf, const __u8 rgb[3])
+{
+    __u32 pixel = pf->opaque, v;
+    int c, s;
+
+    for (c = 0; c < 3; c++) {
+	v = 0;
+	for (s = pf->length[c]; s > 0; s -= 8)
+	    v |= s >= 8 ? (__u32)rgb[c] << (s-8) : (__u32)rgb[c] >> (8-s);
+	pixel |= v << pf->offset[c];
+    }
+    return pixel;
+}
+
+
+    /*
+     *  Convert n RGB Pixels
+     */
+
+void RGBToPixels(const struct PixelFormat *pf, void *dst, const __u8 *rgb,
+		 u_int n)
+{
+    __u8 *p = dst;
+    __u32 pixel;
+    __u16 pixel16;
+
+    for (; n--; rgb += 3, p += pf->bytes) {
+	pixel = PixelFromRGB(pf, rgb);
+	switch (pf->bytes) {
+	    case 1:
+		p[0] = pixel;
+		break;
+	    case 2:
+		pixel16 = pixel;
+		memcpy(p, &pixel16, 2);
+		break;
+	    case 3:
+		p[0] = pixel;
+		p[1] = pixel >> 8;
+		p[2] = pixel >> 16;
+		break;
+	    case 4:
+		memcpy(p, &pixel, 4);
+		break;
+	}
+    }
+}
+
+
+    /*
+     *  Store len Bytes of Whole Vectors
+     *
+     *  dst is aligned to the vector size, and len a multiple of it.
+     */
+
+#if defined(__SSE2__)
+
+static void StoreSSE2(__u8 *d, const __u8 *s, size_t len)
+{
+    __m128i v0, v1;
+
+    for (; len >= 32; len -= 32, d += 32, s += 32) {
+	v0 = _mm_loadu_si128((const __m128i *)s);
+	v1 = _mm_loadu_si128((const __m128i *)(s+16));
+	_mm_store_si128((__m128i *)d, v0);
+	_mm_store_si128((__m128i *)(d+16), v1);
+    }
+    if (len)
+	_mm_store_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+}
+
+#endif /* __SSE2__ */
+
+#ifdef HAVE_AVX2
+
+static TARGET_AVX2 void StoreAVX2(__u8 *d, const __u8 *s, size_t len)
+{
+    __m256i v0, v1;
+
+    for (; len >= 64; len -= 64, d += 64, s += 64) {
+	v0 = _mm256_loadu_si256((const __m256i *)s);
+	v1 = _mm256_loadu_si256((const __m256i *)(s+32));
+	_mm256_store_si256((__m256i *)d, v0);
+	_mm256_store_si256((__m256i *)(d+32), v1);
+    }
+    if (len)
+	_mm256_store_si256((__m256i *)d,
+			   _mm256_loadu_si256((const __m256i *)s));
+}
+
+#endif /* HAVE_AVX2 */
+
+
+    /*
+     *  Store len Bytes of Pixels
+     *
+     *  After the bytes up to the first vector boundary, the frame buffer only
+     *  gets aligned vector stores, of 32 bytes if the processor has AVX2 and
+     *  16 otherwise, and is never read.
+     */
+
+void StorePixels(void *dst, const void *src, size_t len)
+{
+    __u8 *d = dst;
+    const __u8 *s = src;
+#if defined(__SSE2__)
+    void (*store)(__u8 *d, const __u8 *s, size_t len) = StoreSSE2;
+    size_t width = 16, head, n;
+
+#ifdef HAVE_AVX2
+    if (HaveAVX2()) {
+	store = StoreAVX2;
+	width = 32;
+    }
+#endif
+    head = -(uintptr_t)d & (width-1);
+    if (len >= head+width) {
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+	n = len & ~(width-1);
+	store(d, s, n);
+	d += n;
+	s += n;
+	len -= n;
+    }
+#endif
+    memcpy(d, s, len);
+}
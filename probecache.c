@@ -0,0 +1,279 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Cached Probe Results
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Whether a driver accepts a video mode, and how it adjusts it, only
+ *  depends on the driver, its memory and the requested screen info. So the
+ *  outcome of every FB_ACTIVATE_TEST is kept in a small file per driver
+ *  and memory size, <id>-<smem_len>.probes:
+ *
+ *	struct ProbeCacheHeader	header
+ *	struct ProbeCacheEntry	entries[nentries]
+ *
+ *  The header holds the identity of the device: the driver id, the size of
+ *  the frame buffer memory, the accelerator and the kernel release. If any
+ *  of these differ from the device's, the results are thrown away. An entry
+ *  holds the requested screen info, and either what the driver made of it
+ *  or the error it rejected it with.
+ */
+
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#include "fb.h"
+
+#include "fbset.h"
+
+
+#define PROBECACHE_MAGIC	"FBPROBE1"
+#define MAX_PROBES		4096
+#define PROBE_HASHSIZE		(2*MAX_PROBES)
+#define PROBE_SUFFIX		24	/* "/", "fb", "-" smem_len ".probes" */
+
+struct ProbeCacheHeader {
+    char magic[8];
+    char id[16];			/* fix.id */
+    char release[64];			/* uname release */
+    __u32 smem_len;
+    __u32 accel;
+    __u32 nentries;
+    __u32 reserved;
+};
+
+struct ProbeCacheEntry {
+    __u32 hash;				/* of wanted */
+    __u32 error;			/* errno, 0 if accepted */
+    struct fb_var_screeninfo wanted;
+    struct fb_var_screeninfo result;
+};
+
+
+    /*
+     *  Identity of a Device
+     */
+
+static void ProbeCacheIdentity(struct ProbeCacheHeader *header,
+			       const struct fb_fix_screeninfo *fix)
+{
+    struct utsname uts;
+    size_t len;
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, PROBECACHE_MAGIC, sizeof(header->magic));
+    memcpy(header->id, fix->id, sizeof(header->id));
+    if (!uname(&uts)) {
+	len = strlen(uts.release);
+	memcpy(header->release, uts.release,
+	       len < sizeof(header->release) ? len : sizeof(header->release));
+    }
+    header->smem_len = fix->smem_len;
+    header->accel = fix->accel;
+}
+
+
+static __u32 ProbeHash(const struct fb_var_screeninfo *var)
+{
+    return HashString((const char *)var, sizeof(*var));
+}
+
+
+static void ProbeCacheIndex(struct ProbeCache *pc, __u32 i)
+{
+    __u32 h;
+
+    for (h = pc->entries[i].hash & (PROBE_HASHSIZE-1); pc->index[h];
+	 h = (h+1) & (PROBE_HASHSIZE-1));
+    pc->index[h] = i+1;
+}
+
+
+    /*
+     *  Read the Results for a Device
+     *
+     *  The file is named after the driver id and the size of the memory, so
+     *  devices of one driver with different memory sizes do not keep
+     *  replacing each other's results. A missing, damaged or foreign file
+     *  gives an empty cache. Returns -1 if there is no memory.
+     */
+
+int ProbeCacheOpen(struct ProbeCache *pc, const char *dir,
+		   const struct fb_fix_screeninfo *fix)
+{
+    struct ProbeCacheHeader header, want;
+    struct stat st;
+    char *p;
+    int fd;
+    __u32 i;
+
+    memset(pc, 0, sizeof(*pc));
+    pc->fix = *fix;
+    if (!(pc->file = malloc(strlen(dir)+sizeof(fix->id)+PROBE_SUFFIX)) ||
+	!(pc->index = calloc(PROBE_HASHSIZE, sizeof(*pc->index)))) {
+	ProbeCacheClose(pc);
+	return -1;
+    }
+    p = pc->file+sprintf(pc->file, "%s/", dir);
+    for (i = 0; i < sizeof(fix->id) && fix->id[i]; i++)
+	*p++ = isalnum((unsigned char)fix->id[i]) || fix->id[i] == '-' ?
+	       fix->id[i] : '_';
+    sprintf(p, "%s-%u.probes", i ? "" : "fb", fix->smem_len);
+
+    ProbeCacheIdentity(&want, fix);
+    if ((fd = open(pc->file, O_RDONLY)) == -1) {
+	if (errno != ENOENT)
+	    pc->dirty = 1;
+	return 0;
+    }
+    if (fstat(fd, &st) || read(fd, &header, sizeof(header)) != sizeof(header)
+	|| memcmp(&header, &want, offsetof(struct ProbeCacheHeader, nentries))
+	|| header.nentries > MAX_PROBES
+	|| st.st_size != sizeof(header)+header.nentries*
+				       sizeof(struct ProbeCacheEntry)
+	|| !(pc->entries = malloc(header.nentries*sizeof(*pc->entries)+1))
+	|| read(fd, pc->entries, header.nentries*sizeof(*pc->entries)) !=
+	   header.nentries*sizeof(*pc->entries)) {
+	/* stale or damaged, replace it */
+	close(fd);
+	free(pc->entries);
+	pc->entries = NULL;
+	pc->dirty = 1;
+	return 0;
+    }
+    close(fd);
+    pc->nentries = pc->size = header.nentries;
+    for (i = 0; i < pc->nentries; i++)
+	ProbeCacheIndex(pc, i);
+    return 0;
+}
+
+
+    /*
+     *  Look up a Screen Info
+     *
+     *  Returns -1 if it was never tested, else 0 and the screen info the
+     *  driver made of it in result, or the error it rejected it with.
+     */
+
+int ProbeCacheLookup(const struct ProbeCache *pc,
+		     const struct fb_var_screeninfo *var,
+		     struct fb_var_screeninfo *result)
+{
+    const struct ProbeCacheEntry *entry;
+    __u32 hash, h;
+
+    hash = ProbeHash(var);
+    for (h = hash & (PROBE_HASHSIZE-1); pc->index[h];
+	 h = (h+1) & (PROBE_HASHSIZE-1)) {
+	entry = &pc->entries[pc->index[h]-1];
+	if (entry->hash == hash &&
+	    !memcmp(&entry->wanted, var, sizeof(*var))) {
+	    if (!entry->error)
+		*result = entry->result;
+	    return entry->error;
+	}
+    }
+    return -1;
+}
+
+
+    /*
+     *  Remember what the Driver made of a Screen Info
+     *
+     *  result is NULL if the driver rejected it with error. Once the cache
+     *  is full, further results are not kept.
+     */
+
+void ProbeCacheAdd(struct ProbeCache *pc, const struct fb_var_screeninfo *var,
+		   const struct fb_var_screeninfo *result, int error)
+{
+    struct ProbeCacheEntry *entry;
+    __u32 size;
+
+    if (pc->nentries == MAX_PROBES)
+	return;
+    if (pc->nentries == pc->size) {
+	size = pc->size ? 2*pc->size : 64;
+	if (size > MAX_PROBES)
+	    size = MAX_PROBES;
+	if (!(entry = realloc(pc->entries, size*sizeof(*entry))))
+	    return;
+	pc->entries = entry;
+	pc->size = size;
+    }
+    entry = &pc->entries[pc->nentries];
+    memset(entry, 0, sizeof(*entry));
+    entry->hash = ProbeHash(var);
+    entry->error = error;
+    entry->wanted = *var;
+    if (result)
+	entry->result = *result;
+    ProbeCacheIndex(pc, pc->nentries++);
+    pc->dirty = 1;
+}
+
+
+    /*
+     *  Write back new Results and Free the Cache
+     *
+     *  Returns -1 if the file could not be written.
+     */
+
+int ProbeCacheClose(struct ProbeCache *pc)
+{
+    struct ProbeCacheHeader header;
+    char *tmpname = NULL, *slash;
+    size_t size;
+    int fd, res = 0;
+
+    if (pc->dirty) {
+	res = -1;
+	ProbeCacheIdentity(&header, &pc->fix);
+	header.nentries = pc->nentries;
+	size = pc->nentries*sizeof(*pc->entries);
+	slash = strrchr(pc->file, '/');
+	*slash = '\0';
+	if (mkdir(pc->file, 0755) && errno != EEXIST)
+	    goto out;
+	*slash = '/';
+	if (!(tmpname = malloc(strlen(pc->file)+8)))
+	    goto out;
+	sprintf(tmpname, "%s.XXXXXX", pc->file);
+	if ((fd = mkstemp(tmpname)) == -1)
+	    goto out;
+	if (fchmod(fd, 0644) ||
+	    write(fd, &header, sizeof(header)) != sizeof(header) ||
+	    (size && write(fd, pc->entries, size) != size)) {
+	    close(fd);
+	    goto out_unlink;
+	}
+	if (close(fd) || rename(tmpname, pc->file))
+	    goto out_unlink;
+	res = 0;
+	goto out;
+
+out_unlink:
+	unlink(tmpname);
+    }
+out:
+    free(tmpname);
+    free(pc->file);
+    free(pc->entries);
+    free(pc->index);
+    memset(pc, 0, sizeof(*pc));
+    return res;
+}
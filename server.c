@@ -0,0 +1,826 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  The fbset Daemon
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  The daemon keeps the video mode database and the frame buffer devices
+ *  open, and runs fbset commands sent to it over a UNIX domain socket.
+ *
+ *  A request is one line: an id chosen by the client, followed by the
+ *  arguments of the command, separated by blanks. An argument containing
+ *  blanks, quotes or backslashes is put in double quotes, with a backslash
+ *  before each quote or backslash in it:
+ *
+ *	7 -fb /dev/fb1 -move left -step 16
+ *
+ *  The answer is a line with the id, the exit status fbset would have had
+ *  and the length of the output, followed by the output itself:
+ *
+ *	7 0 0
+ *
+ *  Clients need not wait for an answer before sending their next request.
+ *  The requests for a frame buffer device, by its -fb argument, are run in
+ *  order by a worker process of that device, so a slow one, like a mode
+ *  change the driver takes long over, holds up only the requests for the
+ *  same device. A connection gets the answers for one device in the order
+ *  of its requests, but those for another device may come in between.
+ *  A client is not read from while it has many requests at the workers or
+ *  many answers it has not read yet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "fbset.h"
+
+
+#define MAX_REQUEST	4096		/* bytes in a request line */
+#define MAX_CLIENTS	64		/* open connections */
+#define MAX_WORKERS	16		/* devices with a worker */
+#define MAX_JOBS	64		/* requests of a client at the workers */
+#define MAX_OUTPUT	(1024*1024)	/* bytes of answers queued for a client */
+
+
+struct Buffer {
+    char *data;				/* NUL terminated */
+    size_t len;
+    size_t size;
+};
+
+struct Client {
+    int fd;				/* -1 once dropped */
+    int eof;				/* no more requests */
+    int jobs;				/* requests not answered by a worker */
+    size_t inlen;
+    char in[MAX_REQUEST];
+    struct Buffer out;			/* answers not sent yet */
+};
+
+struct Job {
+    struct Job *next;
+    struct Client *client;
+    char id[1];
+};
+
+struct Worker {
+    pid_t pid;
+    int to;				/* requests */
+    int from;				/* answers */
+    struct Buffer out;			/* requests not sent yet */
+    struct Buffer in;			/* answers not complete yet */
+    struct Job *jobs;			/* in the order of the requests */
+    struct Job **last;
+    char device[1];
+};
+
+static struct Client *Clients[MAX_CLIENTS];
+static int NumClients = 0;
+static struct Worker *Workers[MAX_WORKERS];
+static int NumWorkers = 0;
+static int Listener = -1;
+
+static volatile sig_atomic_t Quit = 0;
+static volatile sig_atomic_t Reload = 0;
+
+
+    /*
+     *  Signal Handler
+     */
+
+static void Catch(int sig)
+{
+    if (sig == SIGHUP)
+	Reload = 1;
+    else
+	Quit = 1;
+}
+
+
+    /*
+     *  Split a Request into its Arguments
+     *
+     *  The arguments are unquoted in place. argv must have room for
+     *  MAX_REQUEST_ARGS+1 pointers. Returns the number of arguments, or -1
+     *  for a syntax error.
+     */
+
+int SplitRequest(char *s, char *argv[])
+{
+    char *d;
+    int argc = 0;
+
+    while (1) {
+	while (*s == ' ' || *s == '\t')
+	    s++;
+	if (!*s)
+	    break;
+	if (argc == MAX_REQUEST_ARGS)
+	    return -1;
+	argv[argc++] = d = s;
+	if (*s == '"') {
+	    for (s++; *s != '"'; s++) {
+		if (*s == '\\' && s[1])
+		    s++;
+		if (!*s)
+		    return -1;
+		*d++ = *s;
+	    }
+	    s++;
+	    if (*s && *s != ' ' && *s != '\t')
+		return -1;
+	} else
+	    while (*s && *s != ' ' && *s != '\t')
+		*d++ = *s++;
+	if (*s)
+	    s++;
+	*d = '\0';
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+
+    /*
+     *  Add to a Buffer
+     */
+
+static int Append(struct Buffer *b, const char *data, size_t len)
+{
+    size_t size;
+    char *p;
+
+    if (b->len+len+1 > b->size) {
+	size = b->size ? b->size : 4096;
+	while (size < b->len+len+1)
+	    size *= 2;
+	if (!(p = realloc(b->data, size)))
+	    return -1;
+	b->data = p;
+	b->size = size;
+    }
+    memcpy(b->data+b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+
+    /*
+     *  Remove the first len Bytes of a Buffer
+     */
+
+static void Consume(struct Buffer *b, size_t len)
+{
+    if (!len)
+	return;
+    b->len -= len;
+    memmove(b->data, b->data+len, b->len+1);
+}
+
+
+    /*
+     *  Queue an Answer
+     */
+
+static int Answer(struct Client *c, const char *id, int status,
+		  const char *text, size_t len)
+{
+    char head[MAX_REQUEST+32];
+    size_t hlen;
+
+    hlen = snprintf(head, sizeof(head), "%s %d %lu\n", id, status,
+		    (u_long)len);
+    return Append(&c->out, head, hlen) || Append(&c->out, text, len) ? -1 : 0;
+}
+
+
+    /*
+     *  Read Requests of a Client
+     */
+
+static int ReadInput(struct Client *c)
+{
+    ssize_t n;
+
+    n = read(c->fd, c->in+c->inlen, sizeof(c->in)-c->inlen);
+    if (n == -1)
+	return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    if (n == 0)
+	c->eof = 1;
+    else
+	c->inlen += n;
+    return 0;
+}
+
+
+    /*
+     *  Keep the Part of the Requests from line on
+     *
+     *  A request that does not fit in the buffer is answered with an error,
+     *  and ends the requests of the client.
+     */
+
+static int KeepInput(struct Client *c, char *line)
+{
+    static const char msg[] = "Request too long\n";
+
+    c->inlen -= line-c->in;
+    memmove(c->in, line, c->inlen);
+    if (c->inlen == sizeof(c->in) && !memchr(c->in, '\n', c->inlen)) {
+	c->eof = 1;
+	c->inlen = 0;
+	return Answer(c, "-", 1, msg, sizeof(msg)-1);
+    }
+    return 0;
+}
+
+
+    /*
+     *  Run a Request and Queue its Answer
+     */
+
+static int HandleRequest(struct Client *c, char *line)
+{
+    char *argv[MAX_REQUEST_ARGS+1];
+    char msg[MAX_MESSAGE];
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out;
+    int argc, status, res;
+
+    if ((argc = SplitRequest(line, argv)) == 0)
+	return 0;
+    if (argc < 0) {
+	static const char msg[] = "Bad request\n";
+	return Answer(c, "-", 1, msg, sizeof(msg)-1);
+    }
+
+    if (!(out = open_memstream(&text, &len)))
+	return -1;
+    if ((status = RunRequest(argc, argv, out, msg)) == 1)
+	fprintf(out, "%s\n", msg);
+    if (fclose(out))
+	return -1;
+    res = Answer(c, argv[0], status, text, len);
+    free(text);
+    return res;
+}
+
+
+    /*
+     *  Run the Requests of the Daemon for one Device
+     *
+     *  The worker reads them from in and writes the answers to out, until
+     *  the daemon closes in, or on SIGTERM or SIGINT. SIGHUP reads the video
+     *  mode database again.
+     */
+
+static void RunWorker(int in, int out)
+{
+    struct Client c;
+    char *line, *end;
+    ssize_t n;
+
+    memset(&c, 0, sizeof(c));
+    c.fd = in;
+    while (!Quit && !c.eof) {
+	if (Reload) {
+	    Reload = 0;
+	    LoadModes(NULL);
+	}
+	if (ReadInput(&c))
+	    break;
+	line = c.in;
+	while ((end = memchr(line, '\n', c.in+c.inlen-line))) {
+	    *end = '\0';
+	    if (HandleRequest(&c, line))
+		goto done;
+	    line = end+1;
+	}
+	if (KeepInput(&c, line))
+	    break;
+	while (c.out.len)
+	    if ((n = write(out, c.out.data, c.out.len)) != -1)
+		Consume(&c.out, n);
+	    else if (errno != EINTR)
+		goto done;
+    }
+done:
+    free(c.out.data);
+}
+
+
+    /*
+     *  Start a Worker for a Device
+     *
+     *  When all workers are taken, one without requests makes room.
+     */
+
+static void StopWorker(int i);
+
+static struct Worker *StartWorker(const char *device)
+{
+    struct Worker *w;
+    int to[2], from[2], i;
+
+    if (NumWorkers == MAX_WORKERS) {
+	for (i = 0; i < NumWorkers; i++)
+	    if (!Workers[i]->jobs && !Workers[i]->in.len)
+		break;
+	if (i == NumWorkers)
+	    return NULL;
+	StopWorker(i);
+    }
+
+    if (!(w = calloc(1, sizeof(*w)+strlen(device))))
+	return NULL;
+    strcpy(w->device, device);
+    w->last = &w->jobs;
+    if (pipe(to) == -1) {
+	free(w);
+	return NULL;
+    }
+    if (pipe(from) == -1) {
+	close(to[0]);
+	close(to[1]);
+	free(w);
+	return NULL;
+    }
+    fflush(stdout);
+    if ((w->pid = fork()) == -1) {
+	close(to[0]);
+	close(to[1]);
+	close(from[0]);
+	close(from[1]);
+	free(w);
+	return NULL;
+    }
+
+    if (!w->pid) {
+	close(Listener);
+	for (i = 0; i < NumClients; i++)
+	    if (Clients[i]->fd != -1)
+		close(Clients[i]->fd);
+	for (i = 0; i < NumWorkers; i++) {
+	    close(Workers[i]->to);
+	    close(Workers[i]->from);
+	}
+	close(to[1]);
+	close(from[0]);
+	RunWorker(to[0], from[1]);
+	CloseDevices();
+	exit(0);
+    }
+
+    close(to[0]);
+    close(from[1]);
+    w->to = to[1];
+    w->from = from[0];
+    fcntl(w->to, F_SETFL, O_NONBLOCK);
+    fcntl(w->from, F_SETFL, O_NONBLOCK);
+    Workers[NumWorkers++] = w;
+    return w;
+}
+
+
+    /*
+     *  Send Queued Requests to a Worker
+     */
+
+static int WriteWorker(struct Worker *w)
+{
+    ssize_t n;
+
+    n = write(w->to, w->out.data, w->out.len);
+    if (n == -1)
+	return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    Consume(&w->out, n);
+    return 0;
+}
+
+
+    /*
+     *  Drop a Client
+     *
+     *  A client with requests at the workers is freed once they are answered.
+     */
+
+static void DropClient(int i)
+{
+    struct Client *c = Clients[i];
+
+    if (c->fd != -1) {
+	close(c->fd);
+	c->fd = -1;
+    }
+    if (c->jobs)
+	return;
+    free(c->out.data);
+    free(c);
+    Clients[i] = Clients[--NumClients];
+}
+
+
+    /*
+     *  Pass the Requests of a Client to the Workers of their Devices
+     */
+
+static int Dispatch(struct Client *c)
+{
+    static const char busy[] = "Too many devices busy\n";
+    static const char bad[] = "Bad request\n";
+    char copy[MAX_REQUEST], *argv[MAX_REQUEST_ARGS+1], *line, *end;
+    const char *device;
+    struct Worker *w;
+    struct Job *job;
+    int argc, i;
+
+    line = c->in;
+    while (c->jobs < MAX_JOBS && c->out.len < MAX_OUTPUT &&
+	   (end = memchr(line, '\n', c->in+c->inlen-line))) {
+	*end = '\0';
+	strcpy(copy, line);
+	if ((argc = SplitRequest(copy, argv)) < 0) {
+	    if (Answer(c, "-", 1, bad, sizeof(bad)-1))
+		return -1;
+	} else if (argc) {
+	    device = DEFAULT_FRAMEBUFFER;
+	    for (i = 1; i < argc-1; i++)
+		if (!strcmp(argv[i], "-fb"))
+		    device = argv[++i];
+	    for (i = 0; i < NumWorkers; i++)
+		if (!strcmp(Workers[i]->device, device))
+		    break;
+	    if (!(w = i < NumWorkers ? Workers[i] : StartWorker(device))) {
+		if (Answer(c, argv[0], 1, busy, sizeof(busy)-1))
+		    return -1;
+	    } else {
+		*end = '\n';
+		if (!(job = malloc(sizeof(*job)+strlen(argv[0]))) ||
+		    Append(&w->out, line, end+1-line)) {
+		    free(job);
+		    return -1;
+		}
+		job->next = NULL;
+		job->client = c;
+		strcpy(job->id, argv[0]);
+		*w->last = job;
+		w->last = &job->next;
+		c->jobs++;
+		/* a worker that is gone shows up on its answers */
+		WriteWorker(w);
+	    }
+	}
+	line = end+1;
+    }
+    return KeepInput(c, line);
+}
+
+
+    /*
+     *  Queue the Answer of a Worker for the Client of the Request
+     */
+
+static void Deliver(struct Job *job, const char *answer, size_t len)
+{
+    struct Client *c = job->client;
+
+    free(job);
+    c->jobs--;
+    if (c->fd != -1 && (Append(&c->out, answer, len) || Dispatch(c))) {
+	close(c->fd);
+	c->fd = -1;
+    }
+}
+
+
+    /*
+     *  Read Answers of a Worker
+     */
+
+static int ReadWorker(struct Worker *w)
+{
+    char buf[4096], *p, *nl;
+    struct Job *job;
+    size_t size;
+    ssize_t n;
+    u_long len;
+
+    n = read(w->from, buf, sizeof(buf));
+    if (n == -1)
+	return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    if (n == 0 || Append(&w->in, buf, n))
+	return -1;
+
+    p = w->in.data;
+    while ((nl = memchr(p, '\n', w->in.data+w->in.len-p))) {
+	if (sscanf(p, "%*s %*d %lu", &len) != 1 || !(job = w->jobs))
+	    return -1;
+	size = nl+1-p+len;
+	if (size > (size_t)(w->in.data+w->in.len-p))
+	    break;
+	if (!(w->jobs = job->next))
+	    w->last = &w->jobs;
+	Deliver(job, p, size);
+	p += size;
+    }
+    Consume(&w->in, p-w->in.data);
+    return 0;
+}
+
+
+    /*
+     *  Stop a Worker
+     *
+     *  Requests it has not answered fail.
+     */
+
+static void StopWorker(int i)
+{
+    static const char msg[] = "The worker for the device has exited\n";
+    char answer[MAX_REQUEST+32+sizeof(msg)];
+    struct Worker *w = Workers[i];
+    struct Job *job;
+    int n;
+
+    Workers[i] = Workers[--NumWorkers];
+    close(w->to);
+    close(w->from);
+    waitpid(w->pid, NULL, 0);
+    while ((job = w->jobs)) {
+	w->jobs = job->next;
+	n = snprintf(answer, sizeof(answer), "%s 1 %lu\n%s", job->id,
+		     (u_long)sizeof(msg)-1, msg);
+	Deliver(job, answer, n);
+    }
+    free(w->out.data);
+    free(w->in.data);
+    free(w);
+}
+
+
+    /*
+     *  Send Queued Answers to a Client
+     */
+
+static int WriteClient(struct Client *c)
+{
+    ssize_t n;
+
+    n = write(c->fd, c->out.data, c->out.len);
+    if (n == -1)
+	return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    Consume(&c->out, n);
+    return 0;
+}
+
+
+    /*
+     *  Open the Listening Socket
+     *
+     *  A socket left behind by a daemon that is gone is replaced.
+     */
+
+static int OpenSocket(const char *path)
+{
+    struct sockaddr_un addr;
+    mode_t mask;
+    int fd, other;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+	Die("Socket name `%s' is too long\n", path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	Die("socket: %s\n", strerror(errno));
+    /* only the owner may connect, from the moment the socket exists */
+    mask = umask(077);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+	if (errno != EADDRINUSE)
+	    Die("bind %s: %s\n", path, strerror(errno));
+	if ((other = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	    Die("socket: %s\n", strerror(errno));
+	if (!connect(other, (struct sockaddr *)&addr, sizeof(addr)))
+	    Die("A daemon is already listening on `%s'\n", path);
+	close(other);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+	    Die("bind %s: %s\n", path, strerror(errno));
+    }
+    umask(mask);
+    if (listen(fd, 16) == -1)
+	Die("%s: %s\n", path, strerror(errno));
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+
+    /*
+     *  Serve Requests until SIGTERM or SIGINT
+     *
+     *  SIGHUP reads the video mode database again, here and in the workers.
+     */
+
+void ServeRequests(const char *path, int verbose)
+{
+    struct pollfd fds[MAX_CLIENTS+2*MAX_WORKERS+1];
+    struct sigaction sa;
+    struct Client *c;
+    struct Worker *w;
+    int nc, nw, fd, events, i;
+    short revents;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = Catch;
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    Listener = OpenSocket(path);
+    if (verbose)
+	printf("Listening on `%s'\n", path);
+    fflush(stdout);
+
+    while (!Quit) {
+	if (Reload) {
+	    Reload = 0;
+	    if (verbose)
+		puts("Reading the video mode database again");
+	    LoadModes(verbose ? stdout : NULL);
+	    fflush(stdout);
+	    for (i = 0; i < NumWorkers; i++)
+		kill(Workers[i]->pid, SIGHUP);
+	}
+
+	/* clients, the answers and requests of each worker, new clients */
+	nc = NumClients;
+	nw = NumWorkers;
+	for (i = 0; i < nc; i++) {
+	    c = Clients[i];
+	    events = c->out.len ? POLLOUT : 0;
+	    if (!c->eof && c->inlen < sizeof(c->in) && c->jobs < MAX_JOBS &&
+		c->out.len < MAX_OUTPUT)
+		events |= POLLIN;
+	    fds[i].fd = events ? c->fd : -1;
+	    fds[i].events = events;
+	}
+	for (i = 0; i < nw; i++) {
+	    w = Workers[i];
+	    fds[nc+2*i].fd = w->from;
+	    fds[nc+2*i].events = POLLIN;
+	    fds[nc+2*i+1].fd = w->out.len ? w->to : -1;
+	    fds[nc+2*i+1].events = POLLOUT;
+	}
+	fds[nc+2*nw].fd = nc < MAX_CLIENTS ? Listener : -1;
+	fds[nc+2*nw].events = POLLIN;
+
+	if (poll(fds, nc+2*nw+1, -1) == -1) {
+	    if (errno == EINTR)
+		continue;
+	    Die("poll: %s\n", strerror(errno));
+	}
+
+	if (fds[nc+2*nw].revents & POLLIN &&
+	    (fd = accept(Listener, NULL, NULL)) != -1) {
+	    if ((c = calloc(1, sizeof(*c)))) {
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		c->fd = fd;
+		Clients[NumClients++] = c;
+	    } else
+		close(fd);
+	}
+
+	/* answers may start workers, or stop idle ones to make room */
+	for (i = nw-1; i >= 0; i--) {
+	    if (i >= NumWorkers || (w = Workers[i])->from != fds[nc+2*i].fd)
+		continue;
+	    if ((fds[nc+2*i].revents && ReadWorker(w)) ||
+		(fds[nc+2*i+1].revents && WriteWorker(w)))
+		StopWorker(i);
+	}
+
+	for (i = NumClients-1; i >= 0; i--) {
+	    c = Clients[i];
+	    if (c->fd == -1) {
+		if (!c->jobs)
+		    DropClient(i);
+		continue;
+	    }
+	    revents = i < nc && c->fd == fds[i].fd ? fds[i].revents : 0;
+	    /* requests held back by the limits go once there is room */
+	    if ((revents & POLLIN && ReadInput(c)) ||
+		(revents & (POLLERR | POLLNVAL)) ||
+		(c->out.len && WriteClient(c)) ||
+		(c->inlen && Dispatch(c)) ||
+		(c->eof && !c->out.len && !c->jobs))
+		DropClient(i);
+	}
+    }
+
+    while (NumWorkers) {
+	kill(Workers[0]->pid, SIGTERM);
+	StopWorker(0);
+    }
+    while (NumClients)
+	DropClient(0);
+    close(Listener);
+    unlink(path);
+}
+
+
+    /*
+     *  Send a Command to the Daemon
+     *
+     *  Prints the output of the command, on stderr if it failed, and returns
+     *  its exit status.
+     */
+
+int SendRequest(const char *path, int argc, char *argv[])
+{
+    struct sockaddr_un addr;
+    char *req = NULL, *ans = NULL, *p, *s;
+    size_t reqlen = 0, anslen = 0, anssize = 0;
+    ssize_t n;
+    u_long len;
+    FILE *f;
+    int fd, status, i;
+
+    if (!(f = open_memstream(&req, &reqlen)))
+	Die("No memory\n");
+    fputs("1", f);
+    for (i = 1; i < argc; i++) {
+	if (strchr(argv[i], '\n'))
+	    Die("Arguments cannot contain newlines\n");
+	if (*argv[i] && !strpbrk(argv[i], " \t\"\\")) {
+	    fprintf(f, " %s", argv[i]);
+	    continue;
+	}
+	fputs(" \"", f);
+	for (s = argv[i]; *s; s++) {
+	    if (*s == '"' || *s == '\\')
+		fputc('\\', f);
+	    fputc(*s, f);
+	}
+	fputc('"', f);
+    }
+    fputc('\n', f);
+    if (fclose(f))
+	Die("No memory\n");
+    if (reqlen > MAX_REQUEST)
+	Die("Request too long\n");
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+	Die("Socket name `%s' is too long\n", path);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	Die("socket: %s\n", strerror(errno));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+	Die("connect %s: %s\n", path, strerror(errno));
+
+    for (p = req; reqlen; p += n, reqlen -= n)
+	if ((n = write(fd, p, reqlen)) == -1)
+	    Die("write %s: %s\n", path, strerror(errno));
+    free(req);
+    shutdown(fd, SHUT_WR);
+
+    do {
+	if (anslen == anssize) {
+	    anssize = anssize ? anssize*2 : 4096;
+	    if (!(ans = realloc(ans, anssize+1)))
+		Die("No memory\n");
+	}
+	if ((n = read(fd, ans+anslen, anssize-anslen)) == -1)
+	    Die("read %s: %s\n", path, strerror(errno));
+	anslen += n;
+    } while (n);
+    close(fd);
+
+    ans[anslen] = '\0';
+    if (sscanf(ans, "1 %d %lu", &status, &len) != 2 ||
+	!(p = strchr(ans, '\n')) || (u_long)(ans+anslen-(p+1)) != len)
+	Die("Bad answer from `%s'\n", path);
+    fwrite(p+1, 1, len, status == 1 ? stderr : stdout);
+    free(ans);
+    return status;
+}
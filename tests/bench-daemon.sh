@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Time requests to the fbset daemon
+#
+# Usage: bench-daemon.sh [daemoncalls] [fbset]
+#
+# A daemon is started on a socket of its own, with a synthetic database of
+# 1000 modes, and two of them are set in turn on the fake frame buffer
+# device, first one request at a time and then all requests at once.
+#
+
+DAEMONCALLS=${1:-tests/daemoncalls}
+FBSET=${2:-./fbset}
+DIR=$(mktemp -d) || exit 1
+trap 'kill $pid 2>/dev/null; rm -rf "$DIR"' EXIT
+
+sh "$(dirname "$0")/genmodes.sh" 1000 > "$DIR/fb.modes" || exit 1
+"$FBSET" -db "$DIR/fb.modes" --nocache --daemon --socket "$DIR/sock" \
+    > /dev/null &
+pid=$!
+i=0
+while [ ! -S "$DIR/sock" ]; do
+    i=$((i+1))
+    [ $i -le 50 ] && kill -0 $pid 2>/dev/null ||
+	{ echo "The daemon did not start" >&2; exit 1; }
+    sleep 0.1
+done
+"$DAEMONCALLS" "$DIR/sock" m10 m500
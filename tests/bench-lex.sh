@@ -0,0 +1,16 @@
+#!/bin/sh
+#
+# Time the video mode database scanner on its own
+#
+# Usage: bench-lex.sh [modetokens]
+#
+# Scans a synthetic database of 100k modes (about 12 MB) with the scanner
+# fbset was built with, and prints the tokens and bytes per second.
+#
+
+MODETOKENS=${1:-tests/modetokens}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+sh "$(dirname "$0")/genmodes.sh" 100000 > "$DIR/fb.modes" || exit 1
+"$MODETOKENS" -b "$DIR/fb.modes"
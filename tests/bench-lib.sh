@@ -0,0 +1,18 @@
+#!/bin/sh
+#
+# Time mode changes with library calls and with fbset
+#
+# Usage: bench-lib.sh [libcalls] [fbset]
+#
+# Two modes of a synthetic database of 1000 modes are set in turn on the
+# fake frame buffer device, with library calls on one handle, on a new
+# handle every time, and by running fbset.
+#
+
+LIBCALLS=${1:-tests/libcalls}
+FBSET=${2:-./fbset}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+sh "$(dirname "$0")/genmodes.sh" 1000 > "$DIR/fb.modes" || exit 1
+"$LIBCALLS" "$FBSET" "$DIR/fb.modes" m10 m500
@@ -0,0 +1,26 @@
+#!/bin/sh
+#
+# Time loading video mode databases of 1k to 1M modes
+#
+# Usage: bench-load.sh [fbset]
+#
+# Every database is parsed in full (--strict, without a compiled copy), and
+# the time fbset spent in the database is taken from --stats. With a linear
+# loader the time per mode stays about the same for all sizes.
+#
+
+FBSET=${1:-./fbset}
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+printf "%8s %12s %12s\n" modes ms ns/mode
+for n in 1000 10000 100000 1000000; do
+    sh "$(dirname "$0")/genmodes.sh" $n > "$DIR/fb.modes" || exit 1
+    ns=$("$FBSET" -fb fake -db "$DIR/fb.modes" --nocache --strict --stats \
+	 --test m$((n-1)) 2>&1 |
+	 sed -n 's/.*modedb_ns=\([0-9]*\).*/\1/p')
+    [ -n "$ns" ] || { echo "fbset failed for $n modes" >&2; exit 1; }
+    awk -v n=$n -v ns=$ns 'BEGIN {
+	printf "%8d %12.1f %12.0f\n", n, ns/1e6, ns/n
+    }'
+done
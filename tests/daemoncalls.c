@@ -0,0 +1,197 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Daemon Latency Benchmark
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Sends requests to set two video modes in turn on the fake frame buffer
+ *  device to a running daemon. First every request waits for its answer,
+ *  which gives the latency of a request (median, 99th percentile and the
+ *  worst), then all requests are sent at once, which gives the time per
+ *  request when the daemon is kept busy.
+ *
+ *  Usage: daemoncalls socket mode1 mode2 [count]
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define DEVICE		"fake"
+#define DEFAULT_COUNT	10000
+#define MAX_ANSWER	4096		/* bytes of answer buffered */
+#define MAX_NAME	256		/* bytes in a mode name */
+#define MAX_LINE	(MAX_NAME+64)	/* bytes in a request */
+
+static int Socket;
+static char Answer[MAX_ANSWER];
+static size_t AnswerLen = 0;
+
+
+static unsigned long long Nsecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+
+static int Connect(const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+	fprintf(stderr, "Socket name `%s' is too long\n", path);
+	return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((Socket = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+	connect(Socket, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+	fprintf(stderr, "connect %s: %s\n", path, strerror(errno));
+	return -1;
+    }
+    return 0;
+}
+
+
+static int Send(const char *s, size_t len)
+{
+    ssize_t n;
+
+    for (; len; s += n, len -= n)
+	if ((n = write(Socket, s, len)) == -1) {
+	    fprintf(stderr, "write: %s\n", strerror(errno));
+	    return -1;
+	}
+    return 0;
+}
+
+
+    /*
+     *  Read the Answer to Request id
+     *
+     *  The command must have succeeded; its output is skipped.
+     */
+
+static int Receive(u_long id)
+{
+    u_long got, len;
+    char *nl;
+    ssize_t n;
+    int status;
+
+    while (!(nl = memchr(Answer, '\n', AnswerLen))) {
+	if (AnswerLen == MAX_ANSWER ||
+	    (n = read(Socket, Answer+AnswerLen, MAX_ANSWER-AnswerLen)) <= 0) {
+	    fprintf(stderr, "No answer to request %lu\n", id);
+	    return -1;
+	}
+	AnswerLen += n;
+    }
+    *nl = '\0';
+    if (sscanf(Answer, "%lu %d %lu", &got, &status, &len) != 3 ||
+	got != id || status) {
+	fprintf(stderr, "Bad answer to request %lu: `%s'\n", id, Answer);
+	return -1;
+    }
+    len += nl+1-Answer;
+    while (len > AnswerLen) {
+	len -= AnswerLen;
+	if ((n = read(Socket, Answer, MAX_ANSWER)) <= 0) {
+	    fprintf(stderr, "Short answer to request %lu\n", id);
+	    return -1;
+	}
+	AnswerLen = n;
+    }
+    memmove(Answer, Answer+len, AnswerLen-len);
+    AnswerLen -= len;
+    return 0;
+}
+
+
+static size_t Request(char *buf, size_t size, u_long id, const char *mode)
+{
+    return snprintf(buf, size, "%lu -fb %s --force %s\n", id, DEVICE, mode);
+}
+
+
+static int CompareNsecs(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned long long *nsecs, start;
+    u_long count = DEFAULT_COUNT, i;
+    const char *modes[2];
+    char *reqs, *p;
+    size_t len;
+
+    if (argc < 4 || argc > 5 ||
+	(argc == 5 && !(count = strtoul(argv[4], NULL, 10)))) {
+	fprintf(stderr, "Usage: daemoncalls socket mode1 mode2 [count]\n");
+	return 1;
+    }
+    modes[0] = argv[2];
+    modes[1] = argv[3];
+    if (strlen(modes[0]) > MAX_NAME || strlen(modes[1]) > MAX_NAME) {
+	fprintf(stderr, "Mode name too long\n");
+	return 1;
+    }
+    if (!(nsecs = malloc(count*sizeof(*nsecs))) ||
+	!(reqs = malloc(count*MAX_LINE))) {
+	fprintf(stderr, "No memory\n");
+	return 1;
+    }
+    if (Connect(argv[1]))
+	return 1;
+
+    /* one request at a time */
+    for (i = 0; i < count; i++) {
+	len = Request(reqs, MAX_LINE, i, modes[i & 1]);
+	start = Nsecs();
+	if (Send(reqs, len) || Receive(i))
+	    return 1;
+	nsecs[i] = Nsecs()-start;
+    }
+    qsort(nsecs, count, sizeof(*nsecs), CompareNsecs);
+    printf("%-24s %10s %10s %10s %10s\n", "", "requests", "median us",
+	   "99% us", "max us");
+    printf("%-24s %10lu %10.1f %10.1f %10.1f\n", "one at a time", count,
+	   nsecs[count/2]/1e3, nsecs[count*99/100]/1e3,
+	   nsecs[count-1]/1e3);
+
+    /* all at once */
+    for (p = reqs, i = 0; i < count; i++)
+	p += Request(p, MAX_LINE, count+i, modes[i & 1]);
+    start = Nsecs();
+    if (Send(reqs, p-reqs))
+	return 1;
+    for (i = 0; i < count; i++)
+	if (Receive(count+i))
+	    return 1;
+    printf("%-24s %10lu %10.1f\n", "all at once", count,
+	   (Nsecs()-start)/1e3/count);
+    close(Socket);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# Write a randomly damaged copy of a video mode database to stdout
+#
+# Usage: fuzzmodes.sh file seed
+#
+# Makes up to eight random edits: characters the scanners treat specially
+# are inserted, replaced or deleted, and short pieces are repeated. The same
+# seed always gives the same copy.
+#
+
+LC_ALL=C awk -v seed="$2" '
+{
+    text = text $0 "\n"
+}
+
+function pick(s) {
+    return substr(s, int(rand()*length(s))+1, 1)
+}
+
+END {
+    chars = " \t\n\n#\"\"0123456789aeglmnoqrstxyADEGM/,.$-\001\177\377"
+    srand(seed)
+    edits = 1+int(rand()*8)
+    for (i = 0; i < edits; i++) {
+	pos = int(rand()*(length(text)+1))
+	op = int(rand()*4)
+	if (op == 0)
+	    text = substr(text, 1, pos) pick(chars) substr(text, pos+1)
+	else if (op == 1)
+	    text = substr(text, 1, pos) pick(chars) substr(text, pos+2)
+	else if (op == 2)
+	    text = substr(text, 1, pos) substr(text, pos+2)
+	else
+	    text = substr(text, 1, pos) substr(text, pos+1, 1+int(rand()*8)) \
+		   substr(text, pos+1)
+    }
+    printf "%s", text
+}' "$1"
@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# Write a video mode database of N distinct modes to stdout
+#
+# Usage: genmodes.sh N
+#
+# The modes are named m0 ... m<N-1>, with comments, all options and blank
+# lines in between like a hand-written database. The last one is the mode
+# found last by a full parse.
+#
+
+awk -v n="$1" 'BEGIN {
+    for (i = 0; i < n; i++) {
+	x = 320+8*(i%200); y = 200+2*(i%300)
+	printf "# mode %d of %d\n", i, n
+	printf "mode \"m%d\"\n", i
+	printf "    geometry %d %d %d %d %d\n", x, y, x, 2*y, 8*(1+i%4)
+	printf "    timings %d %d %d %d %d %d %d\n", 10000+i%30000, 40, 24, \
+	       32, 11, 96, 2
+	if (i%2)
+	    printf "    hsync high\n    vsync high\n"
+	if (i%4 == 3)
+	    printf "    rgba \"8/16,8/8,8/0,8/24\"\n"
+	if (i%8 == 5)
+	    printf "    laced true\n"
+	printf "endmode\n\n"
+    }
+}'
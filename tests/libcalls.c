@@ -0,0 +1,197 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Library Call Benchmark
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Sets two video modes in turn on the fake frame buffer device, the way a
+ *  display manager would: with library calls on a handle kept open, with a
+ *  new handle for every mode (loading the database and opening the device
+ *  each time), and by running fbset. Prints the time per mode change of
+ *  each.
+ *
+ *  Usage: libcalls fbset database mode1 mode2 [count]
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "libfbset.h"
+
+
+#define DEVICE		"fake"
+#define DEFAULT_COUNT	1000
+#define EXEC_DIVISOR	10		/* runs fbset count/EXEC_DIVISOR times */
+
+static const char *Database;
+
+
+static unsigned long long Nsecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+
+static int Failed(struct FBSet *fs)
+{
+    fprintf(stderr, "%s\n", FBSetErrorMessage(fs));
+    FBSetDestroy(fs);
+    return -1;
+}
+
+
+static int LoadAndOpen(struct FBSet *fs)
+{
+    return FBSetLoadModes(fs, 1, &Database, NULL, NULL, 0) ||
+	   FBSetOpenDevice(fs, DEVICE);
+}
+
+
+static int SetMode(struct FBSet *fs, const char *name)
+{
+    struct VideoMode vmode;
+
+    return FBSetFindMode(fs, name, &vmode) ||
+	   FBSetApplyMode(fs, &vmode, FB_ACTIVATE_NOW);
+}
+
+
+    /*
+     *  Library Calls on one Handle
+     */
+
+static int BenchHandle(const char *modes[2], u_long count)
+{
+    struct FBSet *fs;
+    u_long i;
+
+    if (!(fs = FBSetCreate())) {
+	fprintf(stderr, "No memory\n");
+	return -1;
+    }
+    if (LoadAndOpen(fs))
+	return Failed(fs);
+    for (i = 0; i < count; i++)
+	if (SetMode(fs, modes[i & 1]))
+	    return Failed(fs);
+    FBSetDestroy(fs);
+    return 0;
+}
+
+
+    /*
+     *  Library Calls on a new Handle every Time
+     */
+
+static int BenchNewHandle(const char *modes[2], u_long count)
+{
+    struct FBSet *fs;
+    u_long i;
+
+    for (i = 0; i < count; i++) {
+	if (!(fs = FBSetCreate())) {
+	    fprintf(stderr, "No memory\n");
+	    return -1;
+	}
+	if (LoadAndOpen(fs) || SetMode(fs, modes[i & 1]))
+	    return Failed(fs);
+	FBSetDestroy(fs);
+    }
+    return 0;
+}
+
+
+    /*
+     *  Running fbset
+     *
+     *  Without the compiled database, like the library calls, and with
+     *  --force, so the mode is always set.
+     */
+
+static const char *Fbset;
+
+static int BenchExec(const char *modes[2], u_long count)
+{
+    char *argv[] = {
+	(char *)Fbset, "-fb", DEVICE, "-db", (char *)Database, "--nocache",
+	"--force", NULL, NULL
+    };
+    int status;
+    pid_t pid;
+    u_long i;
+
+    for (i = 0; i < count; i++) {
+	argv[7] = (char *)modes[i & 1];
+	if ((pid = fork()) == -1) {
+	    perror("fork");
+	    return -1;
+	}
+	if (!pid) {
+	    execv(Fbset, argv);
+	    perror(Fbset);
+	    _exit(127);
+	}
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status)) {
+	    fprintf(stderr, "%s %s failed\n", Fbset, argv[7]);
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+
+static const struct {
+    const char *name;
+    int (*bench)(const char *modes[2], u_long count);
+    u_long divisor;
+} Benchmarks[] = {
+    { "library, one handle", BenchHandle, 1 },
+    { "library, new handles", BenchNewHandle, 1 },
+    { "fbset", BenchExec, EXEC_DIVISOR },
+};
+
+
+int main(int argc, char *argv[])
+{
+    const char *modes[2];
+    unsigned long long start, nsecs;
+    u_long count = DEFAULT_COUNT, n;
+    int i;
+
+    if (argc < 5 || argc > 6 ||
+	(argc == 6 && !(count = strtoul(argv[5], NULL, 10)))) {
+	fprintf(stderr,
+		"Usage: libcalls fbset database mode1 mode2 [count]\n");
+	return 1;
+    }
+    Fbset = argv[1];
+    Database = argv[2];
+    modes[0] = argv[3];
+    modes[1] = argv[4];
+
+    printf("%-24s %10s %12s\n", "", "changes", "us/change");
+    for (i = 0; i < sizeof(Benchmarks)/sizeof(*Benchmarks); i++) {
+	if (!(n = count/Benchmarks[i].divisor))
+	    n = 1;
+	start = Nsecs();
+	if (Benchmarks[i].bench(modes, n))
+	    return 1;
+	nsecs = Nsecs()-start;
+	printf("%-24s %10lu %12.1f\n", Benchmarks[i].name, n, nsecs/1e3/n);
+    }
+    return 0;
+}
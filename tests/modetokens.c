@@ -0,0 +1,182 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Video Mode Database Scanner Test
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Runs a scanner over database files, without the parser. Prints every
+ *  token on a line of its own, so the output of the two scanners can be
+ *  compared, or with -b scans the files over and over and prints how many
+ *  tokens per second it got through.
+ *
+ *  Usage: modetokens [-b] file...
+ */
+
+
+#define YYSTYPE		long
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fb.h"
+#include "fbset.h"
+#include "modes.tab.h"
+
+
+#define BENCH_NSECS	1000000000ULL	/* minimum time to scan a file */
+#define BENCH_PASSES	3		/* minimum number of scans */
+
+static const struct {
+    int token;
+    const char *name;
+} TokenNames[] = {
+    { MODE, "MODE" },
+    { GEOMETRY, "GEOMETRY" },
+    { TIMINGS, "TIMINGS" },
+    { HSYNC, "HSYNC" },
+    { VSYNC, "VSYNC" },
+    { CSYNC, "CSYNC" },
+    { GSYNC, "GSYNC" },
+    { EXTSYNC, "EXTSYNC" },
+    { BCAST, "BCAST" },
+    { LACED, "LACED" },
+    { DOUBLE, "DOUBLE" },
+    { RGBA, "RGBA" },
+    { NONSTD, "NONSTD" },
+    { ACCEL, "ACCEL" },
+    { GRAYSCALE, "GRAYSCALE" },
+    { ENDMODE, "ENDMODE" },
+    { INCLUDE, "INCLUDE" },
+    { POLARITY, "POLARITY" },
+    { BOOLEAN, "BOOLEAN" },
+};
+
+
+static unsigned long long Nsecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+
+static int PrintToken(int token, long value, void *arg)
+{
+    FILE *out = arg;
+    int i;
+
+    if (token == STRING) {
+	fprintf(out, "STRING \"%s\"\n", (const char *)value);
+	return 0;
+    }
+    if (token == NUMBER) {
+	fprintf(out, "NUMBER %lu\n", (unsigned long)value);
+	return 0;
+    }
+    for (i = 0; i < sizeof(TokenNames)/sizeof(*TokenNames); i++)
+	if (TokenNames[i].token == token)
+	    break;
+    if (i < sizeof(TokenNames)/sizeof(*TokenNames))
+	fprintf(out, "%s %ld\n", TokenNames[i].name, value);
+    else
+	fprintf(out, "token %d %ld\n", token, value);
+    return 0;
+}
+
+
+static int CountToken(int token, long value, void *arg)
+{
+    (*(unsigned long *)arg)++;
+    return 0;
+}
+
+
+    /*
+     *  Scan a File over and over
+     *
+     *  Strings are terminated in place, so the buffer is restored from a copy
+     *  before every scan, outside the time taken.
+     */
+
+static int BenchFile(struct ModeParser *mp, char *buf, size_t len)
+{
+    unsigned long long nsecs = 0, start;
+    unsigned long tokens = 0, passes;
+    char *copy;
+
+    if (!(copy = malloc(len ? len : 1))) {
+	fprintf(stderr, "No memory\n");
+	return 1;
+    }
+    memcpy(copy, buf, len);
+    for (passes = 0; passes < BENCH_PASSES || nsecs < BENCH_NSECS;
+	 passes++) {
+	memcpy(buf, copy, len);
+	mp->line = 1;
+	start = Nsecs();
+	if (ScanModeBuffer(mp, buf, len, CountToken, &tokens)) {
+	    fprintf(stderr, "%s\n", mp->db->error);
+	    free(copy);
+	    return 1;
+	}
+	nsecs += Nsecs()-start;
+    }
+    free(copy);
+    printf("%s: %lu tokens, %lu bytes: %.1f Mtokens/s, %.1f MB/s\n",
+	   mp->file, tokens/passes, (unsigned long)len, tokens*1e3/nsecs,
+	   passes*len*1e3/nsecs);
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct ModeParser mp;
+    struct stat st;
+    int bench = 0, status = 0, fd, i;
+    char *buf;
+
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+	bench = 1;
+	argc--;
+	argv++;
+    }
+    if (argc < 2) {
+	fprintf(stderr, "Usage: modetokens [-b] file...\n");
+	return 1;
+    }
+
+    for (i = 1; i < argc; i++) {
+	memset(&mp, 0, sizeof(mp));
+	mp.file = argv[i];
+	mp.line = 1;
+	if (!(mp.db = ModeDBCreate())) {
+	    fprintf(stderr, "No memory\n");
+	    return 1;
+	}
+	if ((fd = open(argv[i], O_RDONLY)) == -1 || fstat(fd, &st) ||
+	    !(buf = ModeDBMapFile(mp.db, fd, st.st_size))) {
+	    fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+	    return 1;
+	}
+	close(fd);
+	if (bench)
+	    status |= BenchFile(&mp, buf, st.st_size);
+	else if (ScanModeBuffer(&mp, buf, st.st_size, PrintToken, stdout))
+	    printf("error %s\n", mp.db->error);
+	ModeDBFree(mp.db);
+    }
+    return status;
+}
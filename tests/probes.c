@@ -0,0 +1,172 @@
+/*
+ *  Linux Frame Buffer Device Configuration
+ *
+ *  Probe Cache Test
+ *
+ *  --------------------------------------------------------------------------
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of the Linux
+ *  distribution for more details.
+ *
+ *  Tests the same screen infos on fake frame buffer devices with a probe
+ *  cache in a directory of its own, and checks that a second run answers
+ *  them all from the cache, with the results of the first, and that a
+ *  device with another memory size gets a cache file of its own.
+ *
+ *  Usage: probes
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "libfbset.h"
+
+
+#define SMALL		"fake:mem=2M"
+#define LARGE		"fake:mem=4M"
+
+static const struct {
+    __u32 xres, yres, bpp;
+} Modes[] = {
+    { 640, 480, 8 },
+    { 800, 600, 16 },
+    { 1024, 768, 16 },
+    { 1280, 1024, 8 },
+    { 640, 480, 48 },			/* rejected */
+};
+
+#define NUM_MODES	(sizeof(Modes)/sizeof(*Modes))
+
+struct Results {
+    struct fb_var_screeninfo var[NUM_MODES];
+    int res[NUM_MODES];
+    u_int putvars;			/* FBIOPUT_VSCREENINFO calls */
+};
+
+static int Failures = 0;
+
+
+static void Check(int ok, const char *what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok)
+	Failures++;
+}
+
+
+    /*
+     *  Test all Modes on a Device
+     */
+
+static int Run(const char *device, const char *dir, struct Results *r)
+{
+    struct FBSetStats stats;
+    struct FBSet *fs;
+    u_int i;
+
+    if (!(fs = FBSetCreate())) {
+	fprintf(stderr, "No memory\n");
+	return -1;
+    }
+    if (FBSetOpenDevice(fs, device) || FBSetProbeCache(fs, dir) ||
+	FBSetGetVar(fs, &r->var[0])) {
+	fprintf(stderr, "%s: %s\n", device, FBSetErrorMessage(fs));
+	FBSetDestroy(fs);
+	return -1;
+    }
+    FBSetClearStats(fs);
+    for (i = 0; i < NUM_MODES; i++) {
+	if (i)
+	    r->var[i] = r->var[0];
+	r->var[i].xres = r->var[i].xres_virtual = Modes[i].xres;
+	r->var[i].yres = r->var[i].yres_virtual = Modes[i].yres;
+	r->var[i].bits_per_pixel = Modes[i].bpp;
+	r->res[i] = FBSetTestVar(fs, &r->var[i]);
+    }
+    FBSetGetStats(fs, &stats);
+    r->putvars = stats.calls[FBSET_STAT_PUTVAR];
+    FBSetDestroy(fs);
+    return 0;
+}
+
+
+static int SameResults(const struct Results *a, const struct Results *b)
+{
+    u_int i;
+
+    for (i = 0; i < NUM_MODES; i++)
+	if (a->res[i] != b->res[i] ||
+	    (!a->res[i] && memcmp(&a->var[i], &b->var[i], sizeof(a->var[i]))))
+	    return 0;
+    return 1;
+}
+
+
+static int CountFiles(const char *dir)
+{
+    struct dirent *de;
+    DIR *d;
+    int n = 0;
+
+    if (!(d = opendir(dir)))
+	return -1;
+    while ((de = readdir(d)))
+	if (strstr(de->d_name, ".probes"))
+	    n++;
+    closedir(d);
+    return n;
+}
+
+
+static void RemoveDir(const char *dir)
+{
+    struct dirent *de;
+    char path[PATH_MAX];
+    DIR *d;
+
+    if ((d = opendir(dir))) {
+	while ((de = readdir(d)))
+	    if (strcmp(de->d_name, ".") && strcmp(de->d_name, "..")) {
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		unlink(path);
+	    }
+	closedir(d);
+    }
+    rmdir(dir);
+}
+
+
+int main(int argc, char *argv[])
+{
+    static struct Results first, second, large, third;
+    char dir[] = "/tmp/fbset-probes-XXXXXX";
+
+    if (!mkdtemp(dir)) {
+	perror("mkdtemp");
+	return 1;
+    }
+    if (Run(SMALL, dir, &first) || Run(SMALL, dir, &second) ||
+	Run(LARGE, dir, &large) || Run(SMALL, dir, &third)) {
+	RemoveDir(dir);
+	return 1;
+    }
+
+    Check(first.putvars == NUM_MODES, "the first run asks the driver");
+    Check(!second.putvars, "the second run asks the cache only");
+    Check(SameResults(&first, &second), "the cache gives the same results");
+    Check(large.putvars == NUM_MODES,
+	  "another memory size does not use the cache of the first");
+    Check(first.res[NUM_MODES-1] && !first.res[0],
+	  "rejected modes are cached like accepted ones");
+    Check(!third.putvars && SameResults(&first, &third),
+	  "another memory size does not replace the cache of the first");
+    Check(CountFiles(dir) == 2, "there is a file per memory size");
+    RemoveDir(dir);
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# Check that the flex scanner and the hand-written one give the same tokens
+#
+# Usage: scanners.sh modetokens-flex modetokens-fast
+#
+# Both are run over etc/fb.modes.*, over edge cases of the token syntax and
+# over fuzzed copies of the databases, and their output has to be the same,
+# down to the error message and where it stops.
+#
+
+FLEX=$1
+FAST=$2
+TOP=$(dirname "$0")/..
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+failed=0
+n=0
+
+compare()
+{
+    "$FLEX" "$1" > "$DIR/flex.out" 2>&1
+    "$FAST" "$1" > "$DIR/fast.out" 2>&1
+    n=$((n+1))
+    if ! cmp -s "$DIR/flex.out" "$DIR/fast.out"; then
+	echo "Scanners differ on $2:"
+	diff "$DIR/flex.out" "$DIR/fast.out" | head -10
+	cp "$1" "failed-$n.modes"
+	echo "(kept as failed-$n.modes)"
+	failed=$((failed+1))
+    fi
+}
+
+for f in "$TOP"/etc/fb.modes.*; do
+    compare "$f" "$f"
+done
+
+# edge cases
+i=0
+while read -r text; do
+    i=$((i+1))
+    printf "$text" > "$DIR/edge.modes"
+    compare "$DIR/edge.modes" "edge case $i: $text"
+done <<'CASES'
+
+mode "a"\n
+# comment without a newline
+# comment\n# another\n\n
+"unterminated
+"broken\nstring"\n
+"" "a b" "#x"\n
+0 00 07 08 010 0778 09 123abc\n
+99999999 100000000 4294967295 4294967296 18446744073709551616\n
+12345678 123456789 1234567 0012345678\n
+MODE Mode mOdE endmode ENDMODE geometry1\n
+hsync high vsync LOW laced TRUE double off accel on\n
+bogus 1\n
+rgba "8/0,8/8,8/16,0/0" nonstd 1 grayscale false\n
+mode "a"\r\n
+\t \t  mode\t"a"  \n
+mode "x" $\n
+mode "a\0b"\n
+mode "a"\0 geometry\n
+mode \377\n
+a\n
+ab\n
+abcdefghij\n
+CASES
+
+# fuzzed databases
+for f in "$TOP"/etc/fb.modes.*; do
+    for seed in $(seq 1 50); do
+	sh "$TOP/tests/fuzzmodes.sh" "$f" $seed > "$DIR/fuzz.modes"
+	compare "$DIR/fuzz.modes" "$(basename "$f") fuzzed with seed $seed"
+    done
+done
+
+echo "$n inputs, $failed with different tokens"
+[ $failed = 0 ]